@@ -0,0 +1,185 @@
+#include <stddef.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/flash.h"
+#include "hardware/flash.h"
+#include "calibration.h"
+
+#define CALIBRATION_FLASH_OFFSET (PICO_FLASH_SIZE_BYTES - CALIBRATION_SECTORS * FLASH_SECTOR_SIZE)
+#define CALIBRATION_SLOTS_PER_SECTOR ((int)(FLASH_SECTOR_SIZE / CALIBRATION_SLOT_SIZE))
+#define CALIBRATION_SLOTS (CALIBRATION_SECTORS * CALIBRATION_SLOTS_PER_SECTOR)
+
+static_assert(FLASH_SECTOR_SIZE % CALIBRATION_SLOT_SIZE == 0, "slots must not straddle a sector");
+static_assert(CALIBRATION_SLOT_SIZE % FLASH_PAGE_SIZE == 0, "slots must be a whole number of pages");
+
+CalibrationRecord calibration;
+
+// Holds a whole slot, the flash can only be programmed in whole pages
+static uint8_t slot_buffer[CALIBRATION_SLOT_SIZE];
+
+struct FlashOperation {
+    uint32_t offset;
+    bool erase;
+};
+
+static uint32_t slot_offset(int slot) {
+    return CALIBRATION_FLASH_OFFSET + slot * CALIBRATION_SLOT_SIZE;
+}
+
+static const uint8_t *slot_data(int slot) {
+    return (const uint8_t *)(XIP_BASE + slot_offset(slot));
+}
+
+static int slot_sector(int slot) {
+    return slot / CALIBRATION_SLOTS_PER_SECTOR;
+}
+
+uint32_t calibration_crc32(const uint8_t *data, uint32_t length) {
+    uint32_t crc = 0xFFFFFFFF;
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        for (int j = 0; j < 8; j++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+static bool record_valid(const CalibrationRecord *record) {
+    if (record->magic != CALIBRATION_MAGIC || record->version != CALIBRATION_VERSION ||
+        record->size != sizeof(CalibrationRecord)) {
+        return false;
+    }
+    return record->crc == calibration_crc32((const uint8_t *)record, offsetof(CalibrationRecord, crc));
+}
+
+static bool slot_blank(int slot) {
+    const uint8_t *data = slot_data(slot);
+    for (int i = 0; i < CALIBRATION_SLOT_SIZE; i++) {
+        if (data[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Returns the slot holding the valid record with the highest sequence number, or -1 if there is none
+static int latest_slot() {
+    int latest = -1;
+    uint32_t latest_sequence = 0;
+
+    for (int slot = 0; slot < CALIBRATION_SLOTS; slot++) {
+        const CalibrationRecord *record = (const CalibrationRecord *)slot_data(slot);
+        if (!record_valid(record)) {
+            continue;
+        }
+
+        // Compare as a difference so the sequence number may wrap around
+        if (latest < 0 || (int32_t)(record->sequence - latest_sequence) > 0) {
+            latest = slot;
+            latest_sequence = record->sequence;
+        }
+    }
+
+    return latest;
+}
+
+// Runs with the flash out of use, interrupts are disabled and the other core is paused if running
+static void flash_operation(void *param) {
+    const FlashOperation *operation = (const FlashOperation *)param;
+    if (operation->erase) {
+        flash_range_erase(operation->offset, FLASH_SECTOR_SIZE);
+    } else {
+        flash_range_program(operation->offset, slot_buffer, CALIBRATION_SLOT_SIZE);
+    }
+}
+
+void calibration_defaults() {
+    memset(&calibration, 0, sizeof(calibration));
+    calibration.magic = CALIBRATION_MAGIC;
+    calibration.version = CALIBRATION_VERSION;
+    calibration.size = sizeof(CalibrationRecord);
+    calibration.timing = default_core_timing;
+}
+
+bool calibration_load() {
+    calibration_defaults();
+
+    int slot = latest_slot();
+    if (slot < 0) {
+        return false;
+    }
+
+    memcpy(&calibration, slot_data(slot), sizeof(CalibrationRecord));
+    return true;
+}
+
+void calibration_apply() {
+    core_timing = calibration.timing;
+    core_trim = calibration.trim;
+    coremem_timing_update();
+}
+
+void calibration_capture() {
+    calibration.timing = core_timing;
+    calibration.trim = core_trim;
+}
+
+bool calibration_save() {
+    int latest = latest_slot();
+
+    uint32_t sequence = 0;
+    int slot = 0;
+    if (latest >= 0) {
+        sequence = ((const CalibrationRecord *)slot_data(latest))->sequence + 1;
+        slot = (latest + 1) % CALIBRATION_SLOTS;
+    }
+
+    if (!slot_blank(slot)) {
+        // Never erase the sector holding the latest record, start over at the beginning of the other one
+        if (latest >= 0 && slot_sector(slot) == slot_sector(latest)) {
+            slot = ((slot_sector(latest) + 1) % CALIBRATION_SECTORS) * CALIBRATION_SLOTS_PER_SECTOR;
+        }
+
+        FlashOperation erase = {
+            .offset = CALIBRATION_FLASH_OFFSET + slot_sector(slot) * FLASH_SECTOR_SIZE,
+            .erase = true,
+        };
+        if (flash_safe_execute(flash_operation, &erase, UINT32_MAX) != PICO_OK) {
+            return false;
+        }
+    }
+
+    calibration.magic = CALIBRATION_MAGIC;
+    calibration.version = CALIBRATION_VERSION;
+    calibration.size = sizeof(CalibrationRecord);
+    calibration.sequence = sequence;
+    calibration.crc = calibration_crc32((const uint8_t *)&calibration, offsetof(CalibrationRecord, crc));
+
+    memset(slot_buffer, 0xFF, sizeof(slot_buffer));
+    memcpy(slot_buffer, &calibration, sizeof(CalibrationRecord));
+
+    FlashOperation program = {
+        .offset = slot_offset(slot),
+        .erase = false,
+    };
+    if (flash_safe_execute(flash_operation, &program, UINT32_MAX) != PICO_OK) {
+        return false;
+    }
+
+    return memcmp(slot_data(slot), slot_buffer, CALIBRATION_SLOT_SIZE) == 0;
+}
+
+bool calibration_is_bad(uint8_t address, uint8_t bit) {
+    uint16_t index = (address << 1) | (bit & 1);
+    return (calibration.bad_cores[index >> 3] >> (index & 7)) & 1;
+}
+
+void calibration_mark_bad(uint8_t address, uint8_t bit, bool bad) {
+    uint16_t index = (address << 1) | (bit & 1);
+    if (bad) {
+        calibration.bad_cores[index >> 3] |= (1 << (index & 7));
+    } else {
+        calibration.bad_cores[index >> 3] &= ~(1 << (index & 7));
+    }
+}
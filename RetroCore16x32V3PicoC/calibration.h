@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include "coremem.h"
+
+/* Per-board calibration, persisted in the last two sectors of the flash.
+
+The record is written into the next free slot with an increasing sequence number, so the
+previous record stays valid until the new one is fully programmed and verified. The slots
+rotate through both sectors, and a sector is only erased once the latest record lives in the other one.*/
+
+#define CALIBRATION_MAGIC 0x4C41434D // "MCAL"
+#define CALIBRATION_VERSION 2 // 2: timing in nanoseconds instead of 100ns units
+
+#define CALIBRATION_SECTORS 2
+#define CALIBRATION_SLOT_SIZE 1024
+
+struct CalibrationRecord {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint32_t sequence;
+
+    CoreTiming timing;
+
+    CoreTrim trim;
+
+    // Known bad cores, 1 bit per core, bit 0 and bit 1 of an address are adjacent bits. Filled by
+    // characterise_trims on the first start-up, the campaign adds the cores its tests find failing.
+    uint8_t bad_cores[64];
+
+    uint32_t crc; // CRC-32 of all the preceding bytes
+};
+
+static_assert(sizeof(CalibrationRecord) <= CALIBRATION_SLOT_SIZE, "calibration record does not fit in a slot");
+
+// The calibration in use, defaults until calibration_load finds a valid record
+extern CalibrationRecord calibration;
+
+// Reset the calibration to the compile-time defaults
+void calibration_defaults();
+
+// Load the latest valid record from flash, returns false (and keeps the defaults) if there is none
+bool calibration_load();
+
+// Apply the calibration to the driver, must be called before the first memory access
+void calibration_apply();
+
+// Take the timing and trims currently used by the driver into the calibration
+void calibration_capture();
+
+// Persist the calibration as a new record, returns false if the programmed record does not verify
+bool calibration_save();
+
+bool calibration_is_bad(uint8_t address, uint8_t bit);
+void calibration_mark_bad(uint8_t address, uint8_t bit, bool bad);
+
+uint32_t calibration_crc32(const uint8_t *data, uint32_t length);
@@ -0,0 +1,396 @@
+#include "pico/stdlib.h"
+#include "coremem.h"
+#include "plane_snapshot.h"
+#include "calibration.h"
+#include "telemetry.h"
+#include "campaign.h"
+
+// Backgrounds the plane can hold, the default patterns 0 to 3 are tracked by the snapshot
+#define BACKGROUND_NONE -1
+#define BACKGROUND_IMAGE 4
+
+static CampaignJob jobs[CAMPAIGN_MAX_JOBS];
+static int job_count;
+static int last_job = -1;
+
+static uint8_t state = CAMPAIGN_IDLE;
+static uint8_t flags;
+static uint64_t deadline_us; // 0 without a budget
+static uint64_t run_us;
+
+static PlaneSnapshot snapshot;
+static int background = BACKGROUND_NONE;
+
+// The known bad map of the calibration gained cores since it was last saved
+static bool bad_cores_changed;
+
+uint32_t campaign_pass_steps(const CampaignJob &job) {
+    if (job.test == TEST_IMAGE) {
+        return 1;
+    }
+    return job.last_address - job.first_address + 1;
+}
+
+uint32_t campaign_total_steps(const CampaignJob &job) {
+    return campaign_pass_steps(job) * job.passes;
+}
+
+static bool job_done(const CampaignJob &job) {
+    return job.steps >= campaign_total_steps(job);
+}
+
+static void reset_progress() {
+    for (int i = 0; i < job_count; i++) {
+        jobs[i].steps = 0;
+        jobs[i].failures = 0;
+        jobs[i].pass_failures = 0;
+        jobs[i].pass_us = 0;
+        jobs[i].disturb = {};
+        jobs[i].known_bad = 0;
+        jobs[i].new_bad = 0;
+    }
+    last_job = -1;
+    run_us = 0;
+}
+
+static void set_deadline(uint64_t budget_us) {
+    deadline_us = budget_us ? time_us_64() + budget_us : 0;
+}
+
+// Check the cores a step (and the end of its pass) failed on against the known bad map, and add
+// the new ones
+static void note_failed_cores(int index, uint8_t address) {
+    CampaignJob &job = jobs[index];
+    uint16_t new_bad = 0;
+    uint16_t known_bad = 0;
+
+    for (int core = 0; core < 512; core++) {
+        if (!((failed_cores[core >> 3] >> (core & 7)) & 1)) {
+            continue;
+        }
+
+        if (calibration_is_bad(core >> 1, core & 1)) {
+            known_bad++;
+        } else {
+            calibration_mark_bad(core >> 1, core & 1, true);
+            new_bad++;
+        }
+    }
+
+    if (!new_bad && !known_bad) {
+        return;
+    }
+
+    job.known_bad += known_bad;
+    job.new_bad += new_bad;
+    if (new_bad) {
+        bad_cores_changed = true;
+    }
+    telemetry_emit(EVENT_BAD_CORES, index, address, new_bad, known_bad);
+}
+
+// Address of a step, the adaptive half current test takes its addresses a diagonal at a time
+static uint8_t step_address(const CampaignJob &job, uint32_t step) {
+    uint32_t index = step % campaign_pass_steps(job);
+    if (job.test == TEST_HALF_CURRENT_ADAPTIVE) {
+        return mem_test_half_current_adaptive_order(job.first_address, job.last_address, index);
+    }
+    return job.first_address + index;
+}
+
+// An adaptive half current pass only reads back the cores off the pulsed lines at its end
+static bool adaptive_pass_open(const CampaignJob &job) {
+    return job.test == TEST_HALF_CURRENT_ADAPTIVE && job.steps % campaign_pass_steps(job) != 0;
+}
+
+void campaign_background_lost() {
+    // Read back the plane of an open adaptive pass before it is overwritten, the disturbed cores
+    // would go unnoticed otherwise. The pass carries on over a fresh background.
+    if (last_job >= 0 && background == 0b00 && tracked_snapshot == &snapshot && adaptive_pass_open(jobs[last_job])) {
+        CampaignJob &job = jobs[last_job];
+        uint64_t start = time_us_64();
+        failed_cores_clear();
+        int failures = mem_test_half_current_adaptive_check(&job.disturb);
+        job.failures += failures;
+        job.pass_failures += failures;
+        note_failed_cores(last_job, step_address(job, job.steps - 1));
+
+        uint64_t duration = time_us_64() - start;
+        job.pass_us += duration;
+        run_us += duration;
+    }
+
+    if (tracked_snapshot == &snapshot) {
+        snapshot_release();
+    }
+    background = BACKGROUND_NONE;
+}
+
+// Log the end of a round of the campaign, with the waveform timing jitter seen during it
+static void report_round(uint8_t end_state) {
+    int done = 0;
+    uint32_t failures = 0;
+    for (int i = 0; i < job_count; i++) {
+        done += job_done(jobs[i]);
+        failures += jobs[i].failures;
+    }
+    telemetry_emit(EVENT_CAMPAIGN, end_state, done, failures, run_us / 1000);
+
+    if (bad_cores_changed) {
+        bad_cores_changed = false;
+        if (!calibration_save()) {
+            telemetry_emit(EVENT_CALIBRATION, CALIBRATION_SAVE_FAILED, 0, 0, 0);
+        }
+    }
+
+    waveform_jitter_report();
+    waveform_jitter_clear();
+}
+
+static void stop(uint8_t new_state) {
+    state = new_state;
+    campaign_background_lost();
+    report_round(new_state);
+}
+
+void campaign_clear() {
+    if (state == CAMPAIGN_RUNNING) {
+        stop(CAMPAIGN_ABORTED);
+    }
+    job_count = 0;
+    state = CAMPAIGN_IDLE;
+    reset_progress();
+}
+
+int campaign_add(const CampaignJob &job) {
+    if (job_count == CAMPAIGN_MAX_JOBS || job.passes == 0) {
+        return -1;
+    }
+    if (job.test != TEST_GALLOP && job.test != TEST_HALF_CURRENT && job.test != TEST_HALF_CURRENT_ADAPTIVE &&
+        job.test != TEST_IMAGE) {
+        return -1;
+    }
+    if (job.test != TEST_IMAGE && job.first_address > job.last_address) {
+        return -1;
+    }
+
+    CampaignJob &added = jobs[job_count];
+    added = {};
+    added.test = job.test;
+    added.priority = job.priority;
+    added.default_pattern = job.default_pattern & 0b11;
+    added.bit_pattern = job.bit_pattern & 0b11;
+    added.first_address = job.first_address;
+    added.last_address = job.last_address;
+    added.passes = job.passes;
+
+    return job_count++;
+}
+
+void campaign_start(uint64_t budget_us, uint8_t start_flags) {
+    reset_progress();
+    flags = start_flags;
+    set_deadline(budget_us);
+    state = CAMPAIGN_RUNNING;
+}
+
+bool campaign_resume(uint64_t budget_us) {
+    for (int i = 0; i < job_count; i++) {
+        if (!job_done(jobs[i])) {
+            set_deadline(budget_us);
+            state = CAMPAIGN_RUNNING;
+            return true;
+        }
+    }
+    return false;
+}
+
+void campaign_abort() {
+    if (state == CAMPAIGN_RUNNING) {
+        stop(CAMPAIGN_ABORTED);
+    }
+}
+
+// Highest priority job which is not done, taking turns with the jobs of the same priority. An open
+// adaptive half current pass keeps running, so no other job touches the plane before its check.
+static int pick_job() {
+    if (last_job >= 0 && adaptive_pass_open(jobs[last_job])) {
+        return last_job;
+    }
+
+    int best = -1;
+    for (int n = 1; n <= job_count; n++) {
+        int i = (last_job + n + job_count) % job_count;
+        if (job_done(jobs[i])) {
+            continue;
+        }
+        if (best < 0 || jobs[i].priority > jobs[best].priority) {
+            best = i;
+        }
+    }
+    return best;
+}
+
+static int background_of(const CampaignJob &job) {
+    switch (job.test) {
+    case TEST_GALLOP:
+        return job.default_pattern;
+    case TEST_IMAGE:
+        return BACKGROUND_IMAGE;
+    default:
+        return 0b00;
+    }
+}
+
+static void setup_background(int wanted) {
+    if (wanted == background) {
+        return;
+    }
+
+    campaign_background_lost();
+    if (wanted == BACKGROUND_IMAGE) {
+        mem_test_image_setup();
+    } else {
+        write_all(wanted);
+        snapshot_assume(&snapshot, wanted);
+    }
+    background = wanted;
+}
+
+static int run_step(CampaignJob &job, uint8_t address) {
+    switch (job.test) {
+    case TEST_GALLOP:
+        return mem_test_gallop_internal(address, job.default_pattern, job.bit_pattern, true);
+    case TEST_HALF_CURRENT:
+        return mem_test_half_current_internal(address, true);
+    case TEST_HALF_CURRENT_ADAPTIVE:
+        // The addresses of the open batch still hold the bit pattern, only the first step of the
+        // pass comes after other jobs
+        if (!job.disturb.batch_count) {
+            snapshot_restore();
+        }
+        return mem_test_half_current_adaptive_address(address, &job.disturb);
+    default:
+        return mem_test_image_internal();
+    }
+}
+
+// Log the pass like the test functions do, the gallop variants are told apart by
+// default pattern << 2 | bit pattern
+static void finish_pass(int index) {
+    CampaignJob &job = jobs[index];
+
+    if (job.test == TEST_HALF_CURRENT_ADAPTIVE) {
+        int failures = mem_test_half_current_adaptive_finish(&job.disturb);
+        job.failures += failures;
+        job.pass_failures += failures;
+        telemetry_emit(EVENT_DISTURB, 0, job.disturb.failing_addresses, job.disturb.pulses,
+                       float_bits(job.disturb.failure_rate_bound));
+        job.disturb = {};
+    }
+
+    uint16_t variant = job.test == TEST_GALLOP ? (job.default_pattern << 2) | job.bit_pattern : 0;
+    telemetry_emit(EVENT_TEST_RESULT, job.test, variant, job.pass_failures, job.pass_us);
+    job.pass_failures = 0;
+    job.pass_us = 0;
+}
+
+bool campaign_step() {
+    if (state != CAMPAIGN_RUNNING) {
+        return false;
+    }
+
+    if (deadline_us && time_us_64() >= deadline_us) {
+        stop(CAMPAIGN_EXPIRED);
+        return false;
+    }
+
+    int index = pick_job();
+    if (index < 0) {
+        if (!(flags & CAMPAIGN_REPEAT) || job_count == 0) {
+            stop(CAMPAIGN_FINISHED);
+            return false;
+        }
+        report_round(CAMPAIGN_FINISHED);
+        reset_progress();
+        index = pick_job();
+    }
+    last_job = index;
+
+    CampaignJob &job = jobs[index];
+    uint32_t pass_steps = campaign_pass_steps(job);
+    setup_background(background_of(job));
+
+    for (int n = 0; n < CAMPAIGN_SLICE_STEPS && !job_done(job); n++) {
+        uint64_t start = time_us_64();
+        uint8_t address = step_address(job, job.steps);
+        failed_cores_clear();
+        int failures = run_step(job, address);
+        job.steps++;
+        job.failures += failures;
+        job.pass_failures += failures;
+
+        uint64_t duration = time_us_64() - start;
+        job.pass_us += duration;
+        run_us += duration;
+
+        if (job.steps % pass_steps == 0) {
+            finish_pass(index);
+        }
+        note_failed_cores(index, address);
+    }
+
+    telemetry_emit(EVENT_CAMPAIGN_PROGRESS, index, job.steps / pass_steps, job.steps, job.failures);
+    return true;
+}
+
+void campaign_load_default() {
+    campaign_clear();
+
+    CampaignJob job = {};
+    job.first_address = 0;
+    job.last_address = 255;
+    job.passes = 1;
+
+    // Decreasing priorities keep the order of the old test loop, so every background is written
+    // once per round. The gallop variants of a default pattern share it and take turns.
+    const uint8_t default_patterns[2] = {0b00, 0b11};
+    job.test = TEST_GALLOP;
+    for (int i = 0; i < 2; i++) {
+        for (uint8_t bit_pattern = 0; bit_pattern < 4; bit_pattern++) {
+            job.priority = 3 - i;
+            job.default_pattern = default_patterns[i];
+            job.bit_pattern = bit_pattern;
+            campaign_add(job);
+        }
+    }
+
+    job.test = TEST_HALF_CURRENT_ADAPTIVE;
+    job.priority = 1;
+    campaign_add(job);
+
+    job.test = TEST_IMAGE;
+    job.priority = 0;
+    job.passes = 128;
+    campaign_add(job);
+}
+
+CampaignState campaign_state() {
+    return (CampaignState)state;
+}
+
+uint8_t campaign_flags() {
+    return flags;
+}
+
+int campaign_job_count() {
+    return job_count;
+}
+
+const CampaignJob &campaign_job(int index) {
+    return jobs[index];
+}
+
+uint64_t campaign_run_us() {
+    return run_us;
+}
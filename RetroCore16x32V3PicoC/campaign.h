@@ -0,0 +1,100 @@
+#pragma once
+
+#include <stdint.h>
+#include "coremem.h"
+#include "protocol.h"
+
+/* Test campaign: a list of test jobs run within a wall time budget.
+
+Every job is one of the CommandTest tests (see protocol.h) with its parameters, run over an
+address range for a number of passes. The jobs are cut into steps of one test address (one
+mem_test_image_internal for the image test, which has no address range), and campaign_step runs
+a slice of up to CAMPAIGN_SLICE_STEPS steps, so commands are served in between and the campaign
+can be aborted at any slice. Higher priority jobs run first; jobs of the same priority take
+turns, one slice each. A pass of the adaptive half current test is not interleaved, and when the
+plane is taken away part way through one its whole-plane check runs first.
+
+The background of a test (the default pattern, or the images of the image test) is only written
+when the plane does not hold it yet. While a job keeps running, or the next one uses the same
+background, the addresses a step changed are put back from a snapshot (see plane_snapshot.h).
+
+Progress is logged after every slice (EVENT_CAMPAIGN_PROGRESS), every finished pass logs an
+EVENT_TEST_RESULT like the test functions, and the end of the campaign (or of a round, when it
+repeats) an EVENT_CAMPAIGN followed by the waveform jitter seen during it.
+Aborting or running out of time keeps the progress, campaign_resume carries on from there.
+
+The cores a step finds failing are checked against the known bad map of the calibration (see
+calibration.h): failures of known bad cores are flagged as such, new ones are added to the map,
+which is saved at the end of the round (EVENT_BAD_CORES after the step).*/
+
+#define CAMPAIGN_MAX_JOBS 16
+#define CAMPAIGN_SLICE_STEPS 16
+
+enum CampaignState : uint8_t {
+    CAMPAIGN_IDLE = 0,     // never started, or cleared
+    CAMPAIGN_RUNNING = 1,
+    CAMPAIGN_FINISHED = 2, // every job ran all its passes
+    CAMPAIGN_EXPIRED = 3,  // the time budget ran out
+    CAMPAIGN_ABORTED = 4,
+};
+
+enum CampaignFlags : uint8_t {
+    CAMPAIGN_REPEAT = 1, // start over when every job is done, until aborted or out of time
+    CAMPAIGN_YIELD = 2,  // pause while a host is using the command protocol, other than to control the campaign
+};
+
+struct CampaignJob {
+    // Parameters
+    uint8_t test;            // CommandTest
+    uint8_t priority;        // higher runs first
+    uint8_t default_pattern; // gallop only
+    uint8_t bit_pattern;     // gallop only
+    uint8_t first_address;   // address range, not used by the image test
+    uint8_t last_address;
+    uint16_t passes;         // over the address range, for the image test the number of checks
+
+    // Progress
+    uint32_t steps;          // done so far
+    uint32_t failures;
+    uint32_t pass_failures;  // of the current pass
+    uint64_t pass_us;        // time spent on the current pass
+    DisturbResult disturb;   // of the current pass, adaptive half current only
+    uint32_t known_bad;      // failures of cores already in the known bad map, counted per core
+    uint16_t new_bad;        // cores this job added to the known bad map
+};
+
+// Remove all jobs, stopping the campaign
+void campaign_clear();
+
+// Add a job, only its parameters are used. Returns its index, -1 if the parameters are not valid
+// or there is no room left. Jobs can be added while the campaign runs.
+int campaign_add(const CampaignJob &job);
+
+// Start over from the first step of every job. A budget of 0 runs without a time limit.
+void campaign_start(uint64_t budget_us, uint8_t flags);
+
+// Carry on with the jobs that are not done, with a new budget. Returns false if there are none.
+bool campaign_resume(uint64_t budget_us);
+
+void campaign_abort();
+
+// Run one slice, returns false if the campaign is not running
+bool campaign_step();
+
+// The plane was changed by something else than the campaign, set up the background again
+void campaign_background_lost();
+
+// The test loop of old: every gallop pattern, the adaptive half current test and the image test
+void campaign_load_default();
+
+CampaignState campaign_state();
+uint8_t campaign_flags();
+int campaign_job_count();
+const CampaignJob &campaign_job(int index);
+
+// Steps of one pass and of all passes of a job
+uint32_t campaign_pass_steps(const CampaignJob &job);
+uint32_t campaign_total_steps(const CampaignJob &job);
+
+// Time spent running the steps since the campaign was started, in us
+uint64_t campaign_run_us();
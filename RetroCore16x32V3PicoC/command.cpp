@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/mutex.h"
+#include "coremem.h"
+#include "waveform_program.h"
+#include "command.h"
+#include "campaign.h"
+
+static FrameParser parser;
+static uint8_t response_payload[PROTOCOL_MAX_PAYLOAD];
+static uint8_t response_frame[PROTOCOL_MAX_FRAME];
+static WaveformProgram uploaded_program;
+static uint64_t last_activity_us;
+
+// The responses and the telemetry are sent from different cores, keep their frames apart
+auto_init_mutex(output_mutex);
+
+// Requests which change the contents of the plane, so a running campaign has to write its background again
+static bool changes_plane(uint8_t opcode) {
+    return opcode == CMD_WRITE || opcode == CMD_WRITE_BLOCK || opcode == CMD_WRITE_ALL ||
+           opcode == CMD_RUN_WAVEFORM || opcode == CMD_RUN_TEST;
+}
+
+// Requests which only control the campaign, a host polling its status does not make it yield
+static bool controls_campaign(uint8_t opcode) {
+    return opcode >= CMD_CAMPAIGN_ADD && opcode <= CMD_CAMPAIGN_STATUS;
+}
+
+// Execute a single request, its response data goes to out (at most max bytes). Returns the status.
+static uint8_t execute_request(uint8_t opcode, const uint8_t *data, uint16_t length, uint8_t *out, uint32_t max, uint16_t *out_length) {
+    *out_length = 0;
+
+    if (changes_plane(opcode)) {
+        campaign_background_lost();
+    }
+
+    switch (opcode) {
+    case CMD_PING:
+        if (length > max) {
+            return STATUS_NO_SPACE;
+        }
+        memcpy(out, data, length);
+        *out_length = length;
+        return STATUS_OK;
+
+    case CMD_READ:
+        if (length != 1) {
+            return STATUS_BAD_REQUEST;
+        }
+        if (max < 1) {
+            return STATUS_NO_SPACE;
+        }
+        out[0] = read_memory(data[0]);
+        *out_length = 1;
+        return STATUS_OK;
+
+    case CMD_WRITE:
+        if (length != 2) {
+            return STATUS_BAD_REQUEST;
+        }
+        write_memory(data[0], data[1] & 0b11);
+        return STATUS_OK;
+
+    case CMD_READ_BLOCK: {
+        if (length != 3) {
+            return STATUS_BAD_REQUEST;
+        }
+        uint8_t start = data[0];
+        uint16_t count = protocol_get_u16(data + 1);
+        if (start + count > 256) {
+            return STATUS_BAD_REQUEST;
+        }
+        if (count > max) {
+            return STATUS_NO_SPACE;
+        }
+        for (uint16_t i = 0; i < count; i++) {
+            out[i] = read_memory(start + i);
+        }
+        *out_length = count;
+        return STATUS_OK;
+    }
+
+    case CMD_WRITE_BLOCK: {
+        if (length < 1 || data[0] + (length - 1) > 256) {
+            return STATUS_BAD_REQUEST;
+        }
+        uint8_t start = data[0];
+        for (uint16_t i = 0; i < length - 1; i++) {
+            write_memory(start + i, data[1 + i] & 0b11);
+        }
+        return STATUS_OK;
+    }
+
+    case CMD_WRITE_ALL:
+        if (length != 1) {
+            return STATUS_BAD_REQUEST;
+        }
+        write_all(data[0]);
+        return STATUS_OK;
+
+    case CMD_RUN_WAVEFORM: {
+        // The host reserves room for the samples it asked for, the rest of the frame belongs to later requests
+        if (length < 2) {
+            return STATUS_BAD_REQUEST;
+        }
+        uint16_t max_samples = protocol_get_u16(data);
+        if (max_samples > max) {
+            return STATUS_NO_SPACE;
+        }
+        if (!waveform_decode(&uploaded_program, data + 2, length - 2)) {
+            return STATUS_BAD_REQUEST;
+        }
+        uint32_t samples = waveform_run(&uploaded_program, out, max_samples);
+        *out_length = samples < max_samples ? samples : max_samples;
+        return STATUS_OK;
+    }
+
+    case CMD_RUN_TEST: {
+        if (length < 1) {
+            return STATUS_BAD_REQUEST;
+        }
+        if (max < 4) {
+            return STATUS_NO_SPACE;
+        }
+
+        int failures;
+        if (data[0] == TEST_GALLOP && length == 3) {
+            failures = mem_test_gallop(data[1] & 0b11, data[2] & 0b11);
+        } else if (data[0] == TEST_HALF_CURRENT && length == 1) {
+            failures = mem_test_half_current();
+        } else if (data[0] == TEST_HALF_CURRENT_ADAPTIVE && length == 1) {
+            DisturbResult result;
+            failures = mem_test_half_current_adaptive(&result);
+        } else if (data[0] == TEST_IMAGE && length == 1) {
+            failures = mem_test_image();
+        } else {
+            return STATUS_BAD_REQUEST;
+        }
+
+        protocol_put_u32(out, failures);
+        *out_length = 4;
+        return STATUS_OK;
+    }
+
+    case CMD_CAMPAIGN_ADD: {
+        if (length != 8) {
+            return STATUS_BAD_REQUEST;
+        }
+        if (max < 1) {
+            return STATUS_NO_SPACE;
+        }
+
+        CampaignJob job = {};
+        job.test = data[0];
+        job.priority = data[1];
+        job.default_pattern = data[2];
+        job.bit_pattern = data[3];
+        job.first_address = data[4];
+        job.last_address = data[5];
+        job.passes = protocol_get_u16(data + 6);
+
+        int index = campaign_add(job);
+        if (index < 0) {
+            return STATUS_BAD_REQUEST;
+        }
+        out[0] = index;
+        *out_length = 1;
+        return STATUS_OK;
+    }
+
+    case CMD_CAMPAIGN_CLEAR:
+        campaign_clear();
+        return STATUS_OK;
+
+    case CMD_CAMPAIGN_START:
+        if (length != 9) {
+            return STATUS_BAD_REQUEST;
+        }
+        campaign_start(protocol_get_u64(data), data[8]);
+        return STATUS_OK;
+
+    case CMD_CAMPAIGN_ABORT:
+        campaign_abort();
+        return STATUS_OK;
+
+    case CMD_CAMPAIGN_RESUME:
+        if (length != 8 || !campaign_resume(protocol_get_u64(data))) {
+            return STATUS_BAD_REQUEST;
+        }
+        return STATUS_OK;
+
+    case CMD_CAMPAIGN_STATUS: {
+        int count = campaign_job_count();
+        uint32_t size = 11 + count * 12;
+        if (max < size) {
+            return STATUS_NO_SPACE;
+        }
+
+        out[0] = campaign_state();
+        out[1] = campaign_flags();
+        out[2] = count;
+        protocol_put_u64(out + 3, campaign_run_us());
+        for (int i = 0; i < count; i++) {
+            const CampaignJob &job = campaign_job(i);
+            uint8_t *entry = out + 11 + i * 12;
+            protocol_put_u32(entry, job.steps);
+            protocol_put_u32(entry + 4, campaign_total_steps(job));
+            protocol_put_u32(entry + 8, job.failures);
+        }
+        *out_length = size;
+        return STATUS_OK;
+    }
+
+    default:
+        return STATUS_UNKNOWN_OPCODE;
+    }
+}
+
+uint32_t command_execute(const uint8_t *request, uint32_t size, uint32_t *consumed, uint8_t *response, uint32_t max_size) {
+    uint32_t in = *consumed;
+    uint32_t out = 0;
+
+    // Stop at a request which does not fit any more, it is answered in the next response payload
+    while (in + PROTOCOL_REQUEST_HEADER <= size && out + PROTOCOL_RESPONSE_HEADER <= max_size) {
+        uint16_t seq = protocol_get_u16(request + in);
+        uint8_t opcode = request[in + 2];
+        uint16_t length = protocol_get_u16(request + in + 3);
+        const uint8_t *data = request + in + PROTOCOL_REQUEST_HEADER;
+        uint32_t next = in + PROTOCOL_REQUEST_HEADER + length;
+
+        uint8_t *header = response + out;
+        uint16_t out_length = 0;
+        uint8_t status;
+        if (next > size) {
+            // Truncated request
+            status = STATUS_BAD_REQUEST;
+        } else {
+            status = execute_request(opcode, data, length, header + PROTOCOL_RESPONSE_HEADER,
+                                     max_size - out - PROTOCOL_RESPONSE_HEADER, &out_length);
+            // The requests check the space before they do anything, so it can be run again on its own
+            if (status == STATUS_NO_SPACE && out != 0) {
+                break;
+            }
+            if (!controls_campaign(opcode)) {
+                last_activity_us = time_us_64();
+            }
+        }
+
+        protocol_put_u16(header, seq);
+        header[2] = opcode;
+        header[3] = status;
+        protocol_put_u16(header + 4, out_length);
+        out += PROTOCOL_RESPONSE_HEADER + out_length;
+        in = next;
+    }
+
+    *consumed = in;
+    return out;
+}
+
+bool command_poll(uint32_t timeout_us) {
+    bool handled = false;
+
+    int c;
+    while ((c = getchar_timeout_us(timeout_us)) != PICO_ERROR_TIMEOUT) {
+        timeout_us = 0;
+        if (!protocol_parse(&parser, c)) {
+            continue;
+        }
+
+        uint32_t consumed = 0;
+        uint32_t length;
+        while ((length = command_execute(parser.payload, parser.length, &consumed, response_payload, sizeof(response_payload))) != 0) {
+            command_send(response_payload, length);
+        }
+        handled = true;
+    }
+
+    return handled;
+}
+
+void command_send(const uint8_t *payload, uint32_t length) {
+    mutex_enter_blocking(&output_mutex);
+
+    uint32_t frame_length = protocol_frame(payload, length, response_frame);
+
+    // Raw, so no newline translation touches the binary frame
+    for (uint32_t i = 0; i < frame_length; i++) {
+        putchar_raw(response_frame[i]);
+    }
+    stdio_flush();
+
+    mutex_exit(&output_mutex);
+}
+
+uint64_t command_last_activity_us() {
+    return last_activity_us;
+}
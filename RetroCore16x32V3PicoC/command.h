@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+#include "protocol.h"
+
+// Execute the requests in a request payload (see protocol.h) in order, from byte *consumed on,
+// and write their responses to response. Stops at the first request whose response does not fit
+// any more, *consumed is moved past the ones answered. Returns the size of the response payload,
+// call again for the next one until it returns 0. A response which does not fit in an empty
+// payload is answered with STATUS_NO_SPACE.
+uint32_t command_execute(const uint8_t *request, uint32_t size, uint32_t *consumed, uint8_t *response, uint32_t max_size);
+
+// Handle the frames received over stdio so far and send back their responses. With a timeout,
+// waits up to that long for the first byte when nothing has been received yet. Returns true if at
+// least one frame was handled.
+bool command_poll(uint32_t timeout_us = 0);
+
+// Send a response payload as a frame over stdio, safe to call from either core
+void command_send(const uint8_t *payload, uint32_t length);
+
+// Time of the last handled request which is not a CMD_CAMPAIGN_* one, in microseconds since boot
+// (0 if there was none)
+uint64_t command_last_activity_us();
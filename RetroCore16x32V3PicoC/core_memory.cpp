@@ -0,0 +1,79 @@
+#include "coremem.h"
+#include "core_memory.h"
+
+static size_t clip_length(uint8_t offset, size_t length) {
+    if (offset >= CORE_MEMORY_SIZE) {
+        return 0;
+    }
+    return length < (size_t)(CORE_MEMORY_SIZE - offset) ? length : CORE_MEMORY_SIZE - offset;
+}
+
+// The whole word is known, so a zero only needs the clearing pulse
+static void write_word(uint8_t address, uint8_t value) {
+    write_memory_waveform(address, false, 0b11, false);
+    if (value) {
+        write_memory_waveform(address, true, value, false);
+    }
+}
+
+static void write_byte(uint8_t offset, uint8_t value) {
+    uint8_t address = offset * 4;
+    for (int i = 0; i < 4; i++) {
+        write_word(address + i, (value >> (i * 2)) & 0b11);
+    }
+}
+
+static uint8_t read_byte(uint8_t offset) {
+    uint8_t address = offset * 4;
+    uint8_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        value |= read_memory(address + i) << (i * 2);
+    }
+    return value;
+}
+
+void core_memcpy_to(uint8_t offset, const void *src, size_t length) {
+    const uint8_t *bytes = (const uint8_t *)src;
+    length = clip_length(offset, length);
+
+    for (size_t i = 0; i < length; i++) {
+        write_byte(offset + i, bytes[i]);
+    }
+}
+
+void core_memcpy_from(void *dst, uint8_t offset, size_t length) {
+    uint8_t *bytes = (uint8_t *)dst;
+    length = clip_length(offset, length);
+
+    for (size_t i = 0; i < length; i++) {
+        bytes[i] = read_byte(offset + i);
+    }
+}
+
+void core_memset(uint8_t offset, uint8_t value, size_t length) {
+    length = clip_length(offset, length);
+
+    for (size_t i = 0; i < length; i++) {
+        write_byte(offset + i, value);
+    }
+}
+
+int core_memcmp(uint8_t offset, const void *data, size_t length) {
+    const uint8_t *bytes = (const uint8_t *)data;
+    length = clip_length(offset, length);
+
+    for (size_t i = 0; i < length; i++) {
+        uint8_t address = (offset + i) * 4;
+
+        // Most significant word first, so the first difference also decides the sign
+        for (int word = 3; word >= 0; word--) {
+            uint8_t actual = read_memory(address + word);
+            uint8_t expected = (bytes[i] >> (word * 2)) & 0b11;
+            if (actual != expected) {
+                return actual < expected ? -1 : 1;
+            }
+        }
+    }
+
+    return 0;
+}
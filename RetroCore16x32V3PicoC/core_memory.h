@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* The plane as 64 bytes of linear memory.
+
+Byte i is stored in the 4 addresses 4i to 4i+3, 2 bits each, the lowest bits in the lowest
+address (the packing of plane_snapshot.h). A byte never shares an address with another byte,
+so every operation writes whole words and never has to read back the other bit.
+
+The offset is a byte offset into the view, lengths running past the end are cut off.*/
+
+#define CORE_MEMORY_SIZE 64
+
+void core_memcpy_to(uint8_t offset, const void *src, size_t length);
+void core_memcpy_from(void *dst, uint8_t offset, size_t length);
+void core_memset(uint8_t offset, uint8_t value, size_t length);
+
+// Like memcmp, the core memory is the first operand. Stops reading at the first wrong word.
+int core_memcmp(uint8_t offset, const void *data, size_t length);
@@ -1,78 +1,217 @@
+#include <math.h>
 #include <stdio.h>
-#include <bitset>
 #include <iostream>
 #include "pico/stdlib.h"
 #include "hardware/clocks.h"
+#include "hardware/sync.h"
+#include "hardware/structs/systick.h"
 #include <vector>
+#include "coremem.h"
+#include "waveform_program.h"
+#include "plane_snapshot.h"
+#include "telemetry.h"
+#include "sense_capture.h"
+
+#ifndef COREMEM_SYS_CLOCK_KHZ
+uint32_t coremem_sys_clock_khz = 200000;
+#endif
+
+const CoreTiming default_core_timing = {
+    .address_setup = 200,
+    .inhibit_setup = 100,
+    .saturation = 1000,
+    .y_off_settle = 100,
+    .recovery = 500,
+    .cooldown = 500,
+};
+
+CoreTiming core_timing = default_core_timing;
+
+CoreTrim core_trim;
+
+// The waveform phases in cycles, so write_memory_waveform does not have to convert anything
+static uint32_t address_setup_cycles;
+static uint32_t inhibit_setup_cycles;
+static uint32_t y_off_settle_cycles;
+static uint32_t cooldown_cycles;
+static uint32_t sense_interval_cycles;
+static uint16_t saturation_cycles[256];
+static uint16_t recovery_cycles[256];
+
+// SysTick counts down from 2^24 - 1 at the system clock, so the M0+ has a cycle counter after all
+#define SYSTICK_MASK 0xFFFFFF
+
+static inline uint32_t cycle_stamp() {
+    return systick_hw->cvr;
+}
+
+// Delay in cycles of a waveform phase after applying a trim (in units of 10ns), never negative
+static uint16_t trimmed_cycles(uint16_t delay, int8_t trim) {
+    int32_t ns = delay + trim * 10;
+    return ns > 0 ? ns_to_cycles(ns) : 0;
+}
+
+static void update_address_cycles(uint8_t address) {
+    saturation_cycles[address] = trimmed_cycles(core_timing.saturation, core_trim.saturation[address]);
+    recovery_cycles[address] = trimmed_cycles(core_timing.recovery, core_trim.settle[address]);
+}
+
+void coremem_timing_update() {
+#ifndef COREMEM_SYS_CLOCK_KHZ
+    coremem_sys_clock_khz = clock_get_hz(clk_sys) / 1000;
+#endif
+
+    address_setup_cycles = ns_to_cycles(core_timing.address_setup);
+    inhibit_setup_cycles = ns_to_cycles(core_timing.inhibit_setup);
+    y_off_settle_cycles = ns_to_cycles(core_timing.y_off_settle);
+    cooldown_cycles = ns_to_cycles(core_timing.cooldown);
+    if (sense_config.samples > SENSE_MAX_SAMPLES) {
+        sense_config.samples = SENSE_MAX_SAMPLES;
+    }
+    sense_interval_cycles = sense_config.samples > 1 ? ns_to_cycles(sense_config.window_ns) / (sense_config.samples - 1) : 0;
+
+    for (int address = 0; address < 256; ++address) {
+        update_address_cycles(address);
+    }
+}
+
+void core_trim_clear() {
+    for (int address = 0; address < 256; ++address) {
+        core_trim.saturation[address] = 0;
+        core_trim.settle[address] = 0;
+    }
+    coremem_timing_update();
+}
+
+static int8_t clamp_trim(int trim) {
+    if (trim > 127) trim = 127;
+    if (trim < -128) trim = -128;
+    return trim;
+}
+
+void core_trim_from_lines(const int8_t x_trim[16], const int8_t y_trim[16], const int8_t orientation_trim[2],
+                          const int8_t x_settle[16], const int8_t y_settle[16]) {
+    for (int yAddress = 0; yAddress < 16; ++yAddress) {
+        for (int xAddress = 0; xAddress < 16; ++xAddress) {
+            int address = (yAddress << 4) | xAddress;
+            bool invertX = ((xAddress + yAddress) % 2 != 0);
+
+            core_trim.saturation[address] = clamp_trim(x_trim[xAddress] + y_trim[yAddress] + orientation_trim[invertX]);
+            core_trim.settle[address] = clamp_trim(x_settle[xAddress] + y_settle[yAddress]);
+        }
+    }
+    coremem_timing_update();
+}
+
+void coremem_init() {
+    gpio_init(IHB0_EN_PIN);
+    gpio_init(IHB0_DIR_PIN);
+    gpio_init(IHB1_EN_PIN);
+    gpio_init(IHB1_DIR_PIN);
+    gpio_init(SENSE_RST_PIN);
+    gpio_init(ADDR_X0_PIN);
+    gpio_init(ADDR_X1_PIN);
+    gpio_init(ADDR_X2_PIN);
+    gpio_init(ADDR_X3_PIN);
+    gpio_init(ADDR_Y0_PIN);
+    gpio_init(ADDR_Y1_PIN);
+    gpio_init(ADDR_Y2_PIN);
+    gpio_init(ADDR_Y3_PIN);
+    gpio_init(X_EN_PIN);
+    gpio_init(X_DIR_PIN);
+    gpio_init(Y_EN_PIN);
+    gpio_init(Y_DIR_PIN);
+    gpio_init(DEBUG_EVENT_PIN);
+
+    gpio_init(SENSE0_DATA_PIN);
+    gpio_init(SENSE1_DATA_PIN);
+
+    gpio_put(IHB0_EN_PIN, false);
+    gpio_put(IHB0_DIR_PIN, false);
+    gpio_put(IHB1_EN_PIN, false);
+    gpio_put(IHB1_DIR_PIN, false);
+    gpio_put(SENSE_RST_PIN, false);
+    gpio_put(ADDR_X0_PIN, false);
+    gpio_put(ADDR_X1_PIN, false);
+    gpio_put(ADDR_X2_PIN, false);
+    gpio_put(ADDR_X3_PIN, false);
+    gpio_put(ADDR_Y0_PIN, false);
+    gpio_put(ADDR_Y1_PIN, false);
+    gpio_put(ADDR_Y2_PIN, false);
+    gpio_put(ADDR_Y3_PIN, false);
+    gpio_put(X_EN_PIN, false);
+    gpio_put(X_DIR_PIN, false);
+    gpio_put(Y_EN_PIN, false);
+    gpio_put(Y_DIR_PIN, false);
+    gpio_put(DEBUG_EVENT_PIN, false);
 
-/* The code makes use of some bitwise operations, and assumes that the pins are in consecutive order
-do not change these pins*/
+    gpio_set_dir(IHB0_EN_PIN, GPIO_OUT);
+    gpio_set_dir(IHB0_DIR_PIN, GPIO_OUT);
+    gpio_set_dir(IHB1_EN_PIN, GPIO_OUT);
+    gpio_set_dir(IHB1_DIR_PIN, GPIO_OUT);
+    gpio_set_dir(SENSE_RST_PIN, GPIO_OUT);
+    gpio_set_dir(ADDR_X0_PIN, GPIO_OUT);
+    gpio_set_dir(ADDR_X1_PIN, GPIO_OUT);
+    gpio_set_dir(ADDR_X2_PIN, GPIO_OUT);
+    gpio_set_dir(ADDR_X3_PIN, GPIO_OUT);
+    gpio_set_dir(ADDR_Y0_PIN, GPIO_OUT);
+    gpio_set_dir(ADDR_Y1_PIN, GPIO_OUT);
+    gpio_set_dir(ADDR_Y2_PIN, GPIO_OUT);
+    gpio_set_dir(ADDR_Y3_PIN, GPIO_OUT);
+    gpio_set_dir(X_EN_PIN, GPIO_OUT);
+    gpio_set_dir(X_DIR_PIN, GPIO_OUT);
+    gpio_set_dir(Y_EN_PIN, GPIO_OUT);
+    gpio_set_dir(Y_DIR_PIN, GPIO_OUT);
+    gpio_set_dir(DEBUG_EVENT_PIN, GPIO_OUT);
 
-#define IHB0_EN_PIN 0
-#define IHB0_DIR_PIN 1
-#define IHB1_EN_PIN 2
-#define IHB1_DIR_PIN 3
-#define SENSE_RST_PIN 4
 
-#define ADDR_X0_PIN 5
-#define ADDR_X1_PIN 6
-#define ADDR_X2_PIN 7
-#define ADDR_X3_PIN 8
-#define ADDR_Y0_PIN 9
-#define ADDR_Y1_PIN 10
-#define ADDR_Y2_PIN 11
-#define ADDR_Y3_PIN 12
+    gpio_set_dir(SENSE0_DATA_PIN, GPIO_IN);
+    gpio_set_dir(SENSE1_DATA_PIN, GPIO_IN);
 
-#define X_EN_PIN 13
-#define X_DIR_PIN 14
-#define Y_EN_PIN 15
-#define Y_DIR_PIN 16
-#define DEBUG_EVENT_PIN 17
+    sense_capture_init();
 
-#define SENSE0_DATA_PIN 18
-#define SENSE1_DATA_PIN 19
+    // Free running SysTick at the system clock, as the cycle counter of the jitter measurement
+    systick_hw->rvr = SYSTICK_MASK;
+    systick_hw->cvr = 0;
+    systick_hw->csr = 0b101;
 
-#define DELAY_100NS_TO_CYCLES(delay) (delay * 20)
+    coremem_timing_update();
+}
 
-void set_reset_latch(bool state) {
+void __not_in_flash_func(set_reset_latch)(bool state) {
     gpio_put(SENSE_RST_PIN, state);
 }
 
-void set_address(uint8_t addr) {
+void __not_in_flash_func(set_address)(uint8_t addr) {
     gpio_put_masked(
         (1 << ADDR_X0_PIN) | (1 << ADDR_X1_PIN) | (1 << ADDR_X2_PIN) | (1 << ADDR_X3_PIN) | 
         (1 << ADDR_Y0_PIN) | (1 << ADDR_Y1_PIN) | (1 << ADDR_Y2_PIN) | (1 << ADDR_Y3_PIN), addr << ADDR_X0_PIN);
 }
 
-enum MosfetBridgeState {
-    NONE_CONDUCT_2 = 0b00,
-    CONDUCT_DIR_2 = 0b01,
-    NONE_CONDUCT = 0b10,
-    CONDUCT_DIR_1 = 0b11
-};
 
-void set_x_drv(MosfetBridgeState state) {
+void __not_in_flash_func(set_x_drv)(MosfetBridgeState state) {
     gpio_put_masked((1 << X_DIR_PIN) | (1 << X_EN_PIN), state << X_EN_PIN);
 }
 
-void set_y_drv(MosfetBridgeState state) {
+void __not_in_flash_func(set_y_drv)(MosfetBridgeState state) {
     gpio_put_masked((1 << Y_DIR_PIN) | (1 << Y_EN_PIN), state << Y_EN_PIN);
 }
 
-void set_ihb0(MosfetBridgeState state) {
+void __not_in_flash_func(set_ihb0)(MosfetBridgeState state) {
     gpio_put_masked((1 << IHB0_DIR_PIN) | (1 << IHB0_EN_PIN), state << IHB0_EN_PIN);
 }
 
-void set_ihb1(MosfetBridgeState state) {
+void __not_in_flash_func(set_ihb1)(MosfetBridgeState state) {
     gpio_put_masked((1 << IHB1_DIR_PIN) | (1 << IHB1_EN_PIN), state << IHB1_EN_PIN);
 }
 
 
-// Generate the waveforms which will write either a 1 to selected cores, or write a 0 to selected cores
-// You will need to call this twice to write for example 0b01
-void write_memory_waveform(uint8_t address, bool dir, uint8_t enable_mask, bool reset_latch) {
+// Runs from RAM, so a flash access of the other core (or the USB stack) can not stall it through XIP.
+// With stamps, the SysTick value is recorded at every phase boundary (see record_jitter).
+static void __not_in_flash_func(drive_waveform)(uint8_t address, bool dir, uint8_t enable_mask, bool reset_latch, uint32_t *stamps) {
     set_address(address);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(2));
+    if (stamps) stamps[0] = cycle_stamp();
+    busy_wait_at_least_cycles(address_setup_cycles);
 
     // Our cores are orientated in 2 possible ways
     uint8_t xAddress = address & 0xF;
@@ -100,7 +239,7 @@ void write_memory_waveform(uint8_t address, bool dir, uint8_t enable_mask, bool
         set_x_drv(MosfetBridgeState::CONDUCT_DIR_1);
     }
 
-    //busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    //busy_wait_at_least_cycles(ns_to_cycles(100));
     set_reset_latch(true); // allow data to come in
 
     // inhibit should cancel the X drive currents
@@ -124,7 +263,8 @@ void write_memory_waveform(uint8_t address, bool dir, uint8_t enable_mask, bool
             set_ihb1(MosfetBridgeState::CONDUCT_DIR_1);
         }
     }
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    if (stamps) stamps[1] = cycle_stamp();
+    busy_wait_at_least_cycles(inhibit_setup_cycles);
 
     // Next, Turn on the Y drives
     if (dir) {
@@ -132,336 +272,314 @@ void write_memory_waveform(uint8_t address, bool dir, uint8_t enable_mask, bool
     } else {
         set_y_drv(MosfetBridgeState::CONDUCT_DIR_2);
     }
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10)); // Allow time for core to fully saturate
+    if (stamps) stamps[2] = cycle_stamp();
+    busy_wait_at_least_cycles(saturation_cycles[address]); // Allow time for core to fully saturate
 
     // Turn off the Y drives
     set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    if (stamps) stamps[3] = cycle_stamp();
+    busy_wait_at_least_cycles(y_off_settle_cycles);
     
     // Turn off the X and inhibit drives
     set_ihb0(MosfetBridgeState::NONE_CONDUCT);
     set_ihb1(MosfetBridgeState::NONE_CONDUCT);
     
-    //busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(2));
+    //busy_wait_at_least_cycles(ns_to_cycles(200));
 
     set_x_drv(MosfetBridgeState::NONE_CONDUCT);
+    if (stamps) stamps[4] = cycle_stamp();
 
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+    busy_wait_at_least_cycles(recovery_cycles[address]);
 
     // This is required, so that our current limiting resistors will not overheat
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+    busy_wait_at_least_cycles(cooldown_cycles);
+    if (stamps) stamps[5] = cycle_stamp();
 }
 
-void write_memory(uint8_t address, uint8_t value) {
-    write_memory_waveform(address, false, 0b11, false);
-    //if(value & 0b01){ // Temporary override inhibit is now not used
-    //   write_memory_waveform(address, true, 0b11, false);
-    //}
+uint8_t waveform_mode = WAVEFORM_NORMAL;
+PhaseJitter waveform_jitter[PHASE_COUNT];
 
-    write_memory_waveform(address, true, value, false);
+void waveform_jitter_clear() {
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        waveform_jitter[phase] = {};
+    }
 }
 
-uint8_t read_memory(uint8_t address) {
-    write_memory_waveform(address, false, 0b11, true);
-    uint8_t value = (gpio_get(SENSE1_DATA_PIN) << 1) | gpio_get(SENSE0_DATA_PIN);
-    
-    // Restore the value after read, since reading is destructive
-    write_memory_waveform(address, true, value, false);
-
-    return value;
+void waveform_jitter_report() {
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        const PhaseJitter &jitter = waveform_jitter[phase];
+        for (int bin = 0; bin < JITTER_BINS; bin++) {
+            if (jitter.histogram[bin]) {
+                telemetry_emit(EVENT_JITTER, phase, bin, jitter.histogram[bin], jitter.max_excess);
+            }
+        }
+    }
 }
 
-void basic_core_response_test() {
-    gpio_put(DEBUG_EVENT_PIN, 1);
-
-    busy_wait_us(10);
+static void record_jitter(uint8_t address, const uint32_t stamps[6]) {
+    const uint32_t intended[PHASE_COUNT] = {
+        address_setup_cycles,
+        inhibit_setup_cycles,
+        saturation_cycles[address],
+        y_off_settle_cycles,
+        recovery_cycles[address] + cooldown_cycles,
+    };
+
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        uint32_t actual = (stamps[phase] - stamps[phase + 1]) & SYSTICK_MASK;
+        uint32_t excess = actual > intended[phase] ? actual - intended[phase] : 0;
+
+        PhaseJitter &jitter = waveform_jitter[phase];
+        jitter.samples++;
+        if (excess > jitter.max_excess) {
+            jitter.max_excess = excess;
+        }
 
-    gpio_put(DEBUG_EVENT_PIN, 0);
+        // Bin 0 is no excess at all, bin n holds an excess below 2^n cycles
+        int bin = excess ? 32 - __builtin_clz(excess) : 0;
+        jitter.histogram[bin < JITTER_BINS ? bin : JITTER_BINS - 1]++;
+    }
+}
 
-    set_address(0);
+// Generate the waveforms which will write either a 1 to selected cores, or write a 0 to selected cores
+// You will need to call this twice to write for example 0b01
+void write_memory_waveform(uint8_t address, bool dir, uint8_t enable_mask, bool reset_latch) {
+    if (tracked_snapshot) {
+        snapshot_track(address, dir, enable_mask);
+    }
 
-    // Turn on the X and Y drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
+    uint32_t stamps[6];
+    uint32_t *measure = (waveform_mode & WAVEFORM_MEASURE) ? stamps : nullptr;
 
-    // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
-
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
-    // Turn on the X and Y drive in the opposite direction
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
+    if (waveform_mode & WAVEFORM_CRITICAL) {
+        uint32_t interrupts = save_and_disable_interrupts();
+        drive_waveform(address, dir, enable_mask, reset_latch, measure);
+        restore_interrupts(interrupts);
+    } else {
+        drive_waveform(address, dir, enable_mask, reset_latch, measure);
+    }
 
-    // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+    if (measure) {
+        record_jitter(address, stamps);
+    }
 }
 
-void half_current_core_response_test() {
-    gpio_put(DEBUG_EVENT_PIN, 1);
-
-    busy_wait_us(10);
+void write_memory(uint8_t address, uint8_t value) {
+    write_memory_waveform(address, false, 0b11, false);
+    //if(value & 0b01){ // Temporary override inhibit is now not used
+    //   write_memory_waveform(address, true, 0b11, false);
+    //}
 
-    gpio_put(DEBUG_EVENT_PIN, 0);
+    write_memory_waveform(address, true, value, false);
+}
 
-    set_address(0);
+SenseConfig sense_config = {1, 0};
+SenseStats sense_stats;
+uint8_t sense_weak_reads[256];
 
-    // Send current in direction A
-    // Turn on the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+// Both sense latches in a single SIO read
+static inline uint8_t sense_sample() {
+    return (gpio_get_all() >> SENSE0_DATA_PIN) & 0b11;
+}
 
-    // Turn on the Y drive
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
+// Majority of sense_config.samples samples spread over the window, ties go to the last sample
+static uint8_t sense_vote(uint8_t address) {
+    uint8_t ones[2] = {0, 0};
+    uint8_t sample = 0;
 
-    // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    for (int i = 0; i < sense_config.samples; i++) {
+        if (i) {
+            busy_wait_at_least_cycles(sense_interval_cycles);
+        }
+        sample = sense_sample();
+        ones[0] += sample & 0b01;
+        ones[1] += (sample >> 1) & 0b01;
+    }
 
-    // Turn off the X drive
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+    uint8_t value = 0;
+    bool weak = false;
+    for (int bit = 0; bit < 2; bit++) {
+        uint8_t zeros = sense_config.samples - ones[bit];
+        if (ones[bit] > zeros || (ones[bit] == zeros && (sample >> bit) & 1)) {
+            value |= 1 << bit;
+        }
 
-    // Repeatedly send half current in the opposite direction B
-    for(int i=0; i < 1024; i++) {
-        // Send current in direction A
-        // Turn on the Y drive
-        set_y_drv(MosfetBridgeState::CONDUCT_DIR_1);
-        busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(12));
+        if (ones[bit] && zeros) {
+            sense_stats.weak_bits[bit]++;
+            weak = true;
+        }
+    }
 
-        // Turn off the Y drive
-        set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-        busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+    if (weak) {
+        sense_stats.weak_reads++;
+        if (sense_weak_reads[address] < UINT8_MAX) {
+            sense_weak_reads[address]++;
+        }
+        telemetry_emit(EVENT_WEAK_READ, ones[0] | (ones[1] << 4), address, sense_config.samples, value);
     }
-    
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(30));
 
-    // Send current in the same A:
-    // Turn on the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    return value;
+}
 
-    // Turn on the Y drive
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
+uint8_t failed_cores[64];
 
-    // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+void failed_cores_clear() {
+    for (int i = 0; i < 64; i++) {
+        failed_cores[i] = 0;
+    }
+}
 
-    // Turn off the X drive
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+// Log a read error of a test, and remember which cores failed
+static void test_read_error(uint8_t address, uint8_t expected, uint8_t actual) {
+    failed_cores[address >> 2] |= (expected ^ actual) << ((address & 0b11) << 1);
+    telemetry_read_error(address, expected, actual);
+}
 
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(30));
+void sense_stats_clear() {
+    sense_stats = {};
+    for (int address = 0; address < 256; address++) {
+        sense_weak_reads[address] = 0;
+    }
+}
 
-    // Send currrent in opposite B:
-    // Turn on the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+uint8_t read_memory(uint8_t address) {
+    write_memory_waveform(address, false, 0b11, true);
+    uint8_t value = sense_config.samples > 1 ? sense_vote(address) : sense_sample();
+    sense_stats.reads++;
+    
+    // Restore the value after read, since reading is destructive
+    write_memory_waveform(address, true, value, false);
 
-    // Turn on the Y drive
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
+    return value;
+}
 
-    // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+// Send a full current pulse through the selected core, the X drive first, then the Y drive for the saturation time
+#define WAVE_FULL_PULSE(x_state, y_state) \
+    wave_step(wave_x_drv(x_state), 100), \
+    wave_step(wave_y_drv(y_state), 1000), \
+    wave_step(wave_y_drv(MosfetBridgeState::NONE_CONDUCT), 100), \
+    wave_step(wave_x_drv(MosfetBridgeState::NONE_CONDUCT), 500)
 
-    // Turn off the X drive
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+// Mark the start of a test on the debug pin for the scope, and select core 0
+#define WAVE_DEBUG_EVENT \
+    wave_step(wave_debug(true), 10000), \
+    wave_step(wave_debug(false) | wave_address(0), 0)
 
-    // Send currrent in same opposite direction B:
-    // Turn on the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+const WaveformStep basic_core_response_program[] = {
+    WAVE_DEBUG_EVENT,
 
-    // Turn on the Y drive
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
+    // Turn on the X and Y drive
+    wave_step(wave_x_drv(MosfetBridgeState::CONDUCT_DIR_1), 0),
+    wave_step(wave_y_drv(MosfetBridgeState::CONDUCT_DIR_2), 1000),
 
     // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
-
-    // Turn off the X drive
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
-}
-
-void core_response_test() {
-    gpio_put(DEBUG_EVENT_PIN, 1);
+    wave_step(wave_y_drv(MosfetBridgeState::NONE_CONDUCT), 0),
+    wave_step(wave_x_drv(MosfetBridgeState::NONE_CONDUCT), 500),
+    wave_step(wave_none(), 500),
 
-    busy_wait_us(10);
+    // Turn on the X and Y drive in the opposite direction
+    wave_step(wave_x_drv(MosfetBridgeState::CONDUCT_DIR_2), 0),
+    wave_step(wave_y_drv(MosfetBridgeState::CONDUCT_DIR_1), 1000),
 
-    gpio_put(DEBUG_EVENT_PIN, 0);
+    // Turn off the Y drive
+    wave_step(wave_y_drv(MosfetBridgeState::NONE_CONDUCT), 0),
+    wave_step(wave_x_drv(MosfetBridgeState::NONE_CONDUCT), 500),
+    wave_end(),
+};
 
-    set_address(0);
+const WaveformStep half_current_core_response_program[] = {
+    WAVE_DEBUG_EVENT,
 
     // Send current in direction A
-    // Turn on the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
-
-    // Turn on the Y drive
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
-
-    // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    WAVE_FULL_PULSE(MosfetBridgeState::CONDUCT_DIR_1, MosfetBridgeState::CONDUCT_DIR_2),
 
-    // Turn off the X drive
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+    // Repeatedly send half current in the opposite direction B
+    wave_loop(1024),
+    wave_step(wave_y_drv(MosfetBridgeState::CONDUCT_DIR_1), 1200),
+    wave_step(wave_y_drv(MosfetBridgeState::NONE_CONDUCT), 500),
+    wave_end_loop(),
 
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+    wave_step(wave_none(), 3000),
 
     // Send current in the same A:
-    // Turn on the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    WAVE_FULL_PULSE(MosfetBridgeState::CONDUCT_DIR_1, MosfetBridgeState::CONDUCT_DIR_2),
+    wave_step(wave_none(), 3000),
 
-    // Turn on the Y drive
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
-
-    // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    // Send currrent in opposite B:
+    WAVE_FULL_PULSE(MosfetBridgeState::CONDUCT_DIR_2, MosfetBridgeState::CONDUCT_DIR_1),
 
-    // Turn off the X drive
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+    // Send currrent in same opposite direction B:
+    WAVE_FULL_PULSE(MosfetBridgeState::CONDUCT_DIR_2, MosfetBridgeState::CONDUCT_DIR_1),
+    wave_end(),
+};
 
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
-    // Send current in opposite B:
-    // Turn on the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+const WaveformStep core_response_program[] = {
+    WAVE_DEBUG_EVENT,
 
-    // Turn on the Y drive
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
+    // Send current in direction A
+    WAVE_FULL_PULSE(MosfetBridgeState::CONDUCT_DIR_1, MosfetBridgeState::CONDUCT_DIR_2),
+    wave_step(wave_none(), 500),
 
-    // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    // Send current in the same A:
+    WAVE_FULL_PULSE(MosfetBridgeState::CONDUCT_DIR_1, MosfetBridgeState::CONDUCT_DIR_2),
+    wave_step(wave_none(), 500),
 
-    // Turn off the X drive
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+    // Send current in opposite B:
+    WAVE_FULL_PULSE(MosfetBridgeState::CONDUCT_DIR_2, MosfetBridgeState::CONDUCT_DIR_1),
+    wave_step(wave_none(), 500),
 
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
     // Send curent in same opposite direction B:
-    // Turn on the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
-
-    // Turn on the Y drive
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
-
-    // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
-
-    // Turn off the X drive
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
-}
-
-void core_response_with_inhibit_test() {
-    gpio_put(DEBUG_EVENT_PIN, 1);
-
-    busy_wait_us(10);
-
-    gpio_put(DEBUG_EVENT_PIN, 0);
+    WAVE_FULL_PULSE(MosfetBridgeState::CONDUCT_DIR_2, MosfetBridgeState::CONDUCT_DIR_1),
+    wave_end(),
+};
 
-    set_address(0);
+const WaveformStep core_response_with_inhibit_program[] = {
+    WAVE_DEBUG_EVENT,
 
     // Send current in direction A
-    // Turn on the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    WAVE_FULL_PULSE(MosfetBridgeState::CONDUCT_DIR_1, MosfetBridgeState::CONDUCT_DIR_2),
 
-    // Turn on the Y drive
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
-
-    // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
-
-    // Turn off the X drive
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
-
-    // Send current in opposite direction B (but inhibited): 
+    // Send current in opposite direction B (but inhibited):
     // Turn on the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
-
-    set_ihb0(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    wave_step(wave_x_drv(MosfetBridgeState::CONDUCT_DIR_2), 100),
+    wave_step(wave_ihb0(MosfetBridgeState::CONDUCT_DIR_1), 100),
 
     // Turn on the Y drive
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
+    wave_step(wave_y_drv(MosfetBridgeState::CONDUCT_DIR_1), 1000),
 
     // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    wave_step(wave_y_drv(MosfetBridgeState::NONE_CONDUCT), 100),
 
     // Turn off the inhibit drive
-    set_ihb0(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
-
-    // Turn off the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    wave_step(wave_ihb0(MosfetBridgeState::NONE_CONDUCT), 500),
 
+    // Turn off the X drive, and let the resistors cool down
+    wave_step(wave_x_drv(MosfetBridgeState::NONE_CONDUCT), 500),
 
     // Send current in direction A (you should observe little response, as the previous operation was inhibited)
-    // Turn on the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    WAVE_FULL_PULSE(MosfetBridgeState::CONDUCT_DIR_1, MosfetBridgeState::CONDUCT_DIR_2),
 
-    // Turn on the Y drive
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
-
-    // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+    // Send currrent in same opposite direction B:
+    WAVE_FULL_PULSE(MosfetBridgeState::CONDUCT_DIR_2, MosfetBridgeState::CONDUCT_DIR_1),
+    wave_end(),
+};
 
-    // Turn off the X drive
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+#define PROGRAM_LENGTH(program) (sizeof(program) / sizeof(program[0]))
 
-    // Send currrent in same opposite direction B:
-    // Turn on the X drive
-    set_x_drv(MosfetBridgeState::CONDUCT_DIR_2);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+bool basic_core_response_test() {
+    return waveform_execute(basic_core_response_program, PROGRAM_LENGTH(basic_core_response_program));
+}
 
-    // Turn on the Y drive
-    set_y_drv(MosfetBridgeState::CONDUCT_DIR_1);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(10));
+bool half_current_core_response_test() {
+    return waveform_execute(half_current_core_response_program, PROGRAM_LENGTH(half_current_core_response_program));
+}
 
-    // Turn off the Y drive
-    set_y_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(1));
+bool core_response_test() {
+    return waveform_execute(core_response_program, PROGRAM_LENGTH(core_response_program));
+}
 
-    // Turn off the X drive
-    set_x_drv(MosfetBridgeState::NONE_CONDUCT);
-    busy_wait_at_least_cycles(DELAY_100NS_TO_CYCLES(5));
+bool core_response_with_inhibit_test() {
+    return waveform_execute(core_response_with_inhibit_program, PROGRAM_LENGTH(core_response_with_inhibit_program));
 }
 
 void write_all(bool value) {
@@ -567,8 +685,15 @@ void dump_memory_compare_smiley() {
 
                 gpio_put(DEBUG_EVENT_PIN, 0);
 
-                std::cout << "[err ->]";
+                // Logged, the row is only printed once it has been read
+                telemetry_read_error(address, smiley_16x16[yAddress][xAddress] | (values[xAddress] & 0b10), values[xAddress]);
             }
+        }
+
+        // First row: check bit 0, marking the wrong ones
+        for (int xAddress = 0; xAddress < 16; ++xAddress) {
+            if ((values[xAddress] & 0x01) != smiley_16x16[yAddress][xAddress])
+                std::cout << "[err ->]";
 
             if (values[xAddress] & 0x01)
                 std::cout << "# ";
@@ -661,9 +786,13 @@ void write_smiley(bool right) {
     }
 }
 
-int mem_test_gallop_internal(uint8_t test_address, uint8_t default_pattern, uint8_t bit_pattern) {
+int mem_test_gallop_internal(uint8_t test_address, uint8_t default_pattern, uint8_t bit_pattern, bool restore) {
     int failures = 0;
-    write_all(default_pattern);
+    if (restore) {
+        snapshot_restore();
+    } else {
+        write_all(default_pattern);
+    }
     write_memory(test_address, bit_pattern);
 
     for (int yAddress = 0; yAddress < 16; ++yAddress) {
@@ -673,12 +802,15 @@ int mem_test_gallop_internal(uint8_t test_address, uint8_t default_pattern, uint
 
             uint8_t expected = (address == test_address) ? bit_pattern : default_pattern;
             if (actual != expected) {
+                test_read_error(address, expected, actual);
                 failures++;
             }
         }
     }
 
-    write_memory(test_address, 0);
+    if (!restore) {
+        write_memory(test_address, 0);
+    }
 
     return failures;
 } 
@@ -686,25 +818,37 @@ int mem_test_gallop_internal(uint8_t test_address, uint8_t default_pattern, uint
 int mem_test_gallop(uint8_t default_pattern, uint8_t bit_pattern) {
     int failures = 0;
 
+    // Write the background once, every test address then only puts back what it changed
+    PlaneSnapshot background;
+    write_all(default_pattern);
+    snapshot_assume(&background, default_pattern);
+
     for (int yAddress = 0; yAddress < 16; ++yAddress) {
         for (int xAddress = 0; xAddress < 16; ++xAddress) {
             int address = (yAddress << 4) | xAddress;
 
-            failures += mem_test_gallop_internal(address, default_pattern, bit_pattern);
+            failures += mem_test_gallop_internal(address, default_pattern, bit_pattern, true);
         }
     }
 
+    snapshot_restore();
+    snapshot_release();
+
     return failures;
 }
 
-int mem_test_half_current_internal(uint8_t test_address) {
+int mem_test_half_current_internal(uint8_t test_address, bool restore) {
     int failures = 0;
     
     uint8_t default_pattern = 0b00;
     uint8_t bit_pattern = 0b01;
 
     // Half current threshold stress test
-    write_all(default_pattern);
+    if (restore) {
+        snapshot_restore();
+    } else {
+        write_all(default_pattern);
+    }
 
     // Repeatedly write 1 to a single core,
     // the test checks if such repeated writes affect other cores, ie. you should observe only a single core being 1
@@ -721,6 +865,7 @@ int mem_test_half_current_internal(uint8_t test_address) {
 
             uint8_t expected = (address == test_address) ? bit_pattern : default_pattern;
             if (actual != expected) {
+                test_read_error(address, expected, actual);
                 failures++;
             }
         }
@@ -731,18 +876,205 @@ int mem_test_half_current_internal(uint8_t test_address) {
 
 int mem_test_half_current() {
     int failures = 0;
+
+    PlaneSnapshot background;
+    write_all(0b00);
+    snapshot_assume(&background, 0b00);
     
     for (int yAddress = 0; yAddress < 16; ++yAddress) {
         for (int xAddress = 0; xAddress < 16; ++xAddress) {
             int address = (yAddress << 4) | xAddress;
 
-            failures += mem_test_half_current_internal(address);
+            failures += mem_test_half_current_internal(address, true);
+        }
+    }
+
+    snapshot_restore();
+    snapshot_release();
+
+    return failures;
+}
+
+// Upper bound at 95% confidence of the mean of a Poisson count, given that failures were observed
+// (Wilson-Hilferty approximation, within a few percent of the exact bound, 2.97 for no failures)
+static float poisson_upper_bound(uint32_t failures) {
+    float n = failures + 1;
+    float root = 1.0f - 1.0f / (9.0f * n) + 1.645f / (3.0f * sqrtf(n));
+    return n * root * root * root;
+}
+
+static uint8_t diagonal_of(uint8_t address) {
+    return ((address & 0x0F) - (address >> 4)) & 0x0F;
+}
+
+// Read back the cores off the lines of the open batch, putting disturbed ones back to the default
+// pattern so they are not counted again
+static int half_current_check_plane(uint16_t rows, uint16_t columns, uint8_t default_pattern) {
+    int failures = 0;
+
+    for (int address = 0; address < 256; ++address) {
+        if (((rows >> (address >> 4)) & 1) || ((columns >> (address & 0x0F)) & 1)) {
+            continue;
+        }
+        uint8_t actual = read_memory(address);
+        if (actual != default_pattern) {
+            test_read_error(address, default_pattern, actual);
+            write_memory(address, default_pattern);
+            failures++;
+        }
+    }
+
+    return failures;
+}
+
+// Read back the cores sharing an X or Y line with the addresses of the open batch, and put the
+// pulsed addresses and any disturbed core back to the default pattern. When something failed the
+// rest of the plane is read as well, to tie whatever else the batch disturbed to it, as
+// mem_test_half_current would.
+static int half_current_check_batch(DisturbResult *result) {
+    const uint8_t default_pattern = 0b00;
+    const uint8_t bit_pattern = 0b01;
+
+    if (!result->batch_count) {
+        return 0;
+    }
+
+    uint16_t rows = result->batch_rows;
+    uint16_t columns = 0;
+    for (int y = 0; y < 16; ++y) {
+        if ((rows >> y) & 1) {
+            columns |= 1 << ((y + result->batch_diagonal) & 0x0F);
+        }
+    }
+
+    int failures = 0;
+    uint32_t line_cores = 0;
+    for (int address = 0; address < 256; ++address) {
+        int y = address >> 4;
+        int x = address & 0x0F;
+        if (!((rows >> y) & 1) && !((columns >> x) & 1)) {
+            continue;
+        }
+        line_cores++;
+
+        bool pulsed = ((rows >> y) & 1) && x == ((y + result->batch_diagonal) & 0x0F);
+        uint8_t expected = pulsed ? bit_pattern : default_pattern;
+        uint8_t actual = read_memory(address);
+        if (actual != expected) {
+            test_read_error(address, expected, actual);
+            failures++;
+        }
+        if (actual != default_pattern) {
+            write_memory(address, default_pattern);
+        }
+    }
+
+    if (failures) {
+        failures += half_current_check_plane(rows, columns, default_pattern);
+        result->failing_addresses += result->batch_count;
+    }
+
+    // The bit 0 cores on the lines, the pulsed ones are not half selected
+    result->exposures += line_cores - result->batch_count;
+    result->failures += failures;
+
+    // Put off the next read back for longer while they come out clean
+    if (failures) {
+        result->batch_shift = 0;
+    } else if ((2 << result->batch_shift) <= DISTURB_MAX_BATCH) {
+        result->batch_shift++;
+    }
+    result->batch_rows = 0;
+    result->batch_count = 0;
+
+    return failures;
+}
+
+int mem_test_half_current_adaptive_address(uint8_t test_address, DisturbResult *result) {
+    const uint8_t bit_pattern = 0b01;
+
+    // A batch only holds addresses of one diagonal, which share no line
+    uint8_t diagonal = diagonal_of(test_address);
+    uint16_t row = 1 << (test_address >> 4);
+    int failures = 0;
+    if (result->batch_count && (diagonal != result->batch_diagonal || (result->batch_rows & row))) {
+        failures += half_current_check_batch(result);
+    }
+
+    // All pulses first, reading a core in between would saturate it again and undo the disturb
+    // built up so far
+    for (uint32_t j = 0; j < DISTURB_PULSES; j++) {
+        write_memory_waveform(test_address, true, bit_pattern, false);
+    }
+
+    result->pulses += DISTURB_PULSES;
+    result->plane_unchecked = true;
+    result->batch_diagonal = diagonal;
+    result->batch_rows |= row;
+    result->batch_count++;
+    if (result->batch_count >= (1 << result->batch_shift)) {
+        failures += half_current_check_batch(result);
+    }
+
+    return failures;
+}
+
+int mem_test_half_current_adaptive_check(DisturbResult *result) {
+    const uint8_t default_pattern = 0b00;
+
+    int failures = half_current_check_batch(result);
+
+    // The cores off the lines of a batch were only read when its lines failed, and the bit 1
+    // cores are half selected by every pulse. Check the whole plane once, so nothing is missed
+    // compared to mem_test_half_current.
+    int plane_failures = 0;
+    for (int address = 0; address < 256; ++address) {
+        uint8_t actual = read_memory(address);
+        if (actual != default_pattern) {
+            test_read_error(address, default_pattern, actual);
+            plane_failures++;
         }
     }
+    if (result->plane_unchecked) {
+        result->exposures += DISTURB_INHIBITED;
+        result->plane_unchecked = false;
+    }
+    result->failures += plane_failures;
+
+    return failures + plane_failures;
+}
+
+int mem_test_half_current_adaptive_finish(DisturbResult *result) {
+    int failures = mem_test_half_current_adaptive_check(result);
+    result->failure_rate_bound = poisson_upper_bound(result->failures) / result->exposures;
 
     return failures;
 }
 
+int mem_test_half_current_adaptive(DisturbResult *result) {
+    *result = {};
+
+    write_all(0b00);
+
+    for (int i = 0; i < 256; ++i) {
+        mem_test_half_current_adaptive_address(mem_test_half_current_adaptive_order(0, 255, i), result);
+    }
+    mem_test_half_current_adaptive_finish(result);
+
+    return result->failures;
+}
+
+uint8_t mem_test_half_current_adaptive_order(uint8_t first_address, uint8_t last_address, int index) {
+    for (int i = 0; i < 256; ++i) {
+        int y = i & 0x0F;
+        uint8_t address = (y << 4) | ((y + (i >> 4)) & 0x0F);
+        if (address >= first_address && address <= last_address && index-- == 0) {
+            return address;
+        }
+    }
+    return first_address;
+}
+
 
 const uint8_t smiley_8x8[8][8] = { 
     {0,1,1,1,1,1,1,0},
@@ -834,6 +1166,7 @@ int mem_test_image_internal() {
             }
 
             if (actual != expected) {
+                test_read_error(address, expected, actual);
                 failures++;
             }
         }
@@ -842,9 +1175,7 @@ int mem_test_image_internal() {
     return failures;
 }
 
-int mem_test_image() {
-    int failures = 0;
-    
+void mem_test_image_setup() {
     write_all(0);
 
     // Write a full set of images to bit 0 (group 0)
@@ -854,6 +1185,12 @@ int mem_test_image() {
     draw_image_8x8(8, 8, cross_8x8);
     // Also write a 16x16 image to bit 1 (group 1)
     write_smiley(true);
+}
+
+int mem_test_image() {
+    int failures = 0;
+
+    mem_test_image_setup();
 
     for(int i=0; i<128; i++) {
         failures += mem_test_image_internal();
@@ -862,154 +1199,92 @@ int mem_test_image() {
     return failures;
 }
 
-int main()
-{      
-    // Set cpu clock to 200MHz
-    set_sys_clock_khz(200000, true);
+// Write and read back both patterns a few times at the current trim of the address,
+// returns the bits which did not read back correctly
+static uint8_t trim_probe(uint8_t address) {
+    uint8_t failed = 0;
 
-    stdio_init_all();
+    for (int i = 0; i < 4; i++) {
+        write_memory(address, 0b11);
+        failed |= read_memory(address) ^ 0b11;
+        write_memory(address, 0b00);
+        failed |= read_memory(address);
+    }
 
-    gpio_init(IHB0_EN_PIN);
-    gpio_init(IHB0_DIR_PIN);
-    gpio_init(IHB1_EN_PIN);
-    gpio_init(IHB1_DIR_PIN);
-    gpio_init(SENSE_RST_PIN);
-    gpio_init(ADDR_X0_PIN);
-    gpio_init(ADDR_X1_PIN);
-    gpio_init(ADDR_X2_PIN);
-    gpio_init(ADDR_X3_PIN);
-    gpio_init(ADDR_Y0_PIN);
-    gpio_init(ADDR_Y1_PIN);
-    gpio_init(ADDR_Y2_PIN);
-    gpio_init(ADDR_Y3_PIN);
-    gpio_init(X_EN_PIN);
-    gpio_init(X_DIR_PIN);
-    gpio_init(Y_EN_PIN);
-    gpio_init(Y_DIR_PIN);
-    gpio_init(DEBUG_EVENT_PIN);
+    return failed;
+}
 
-    gpio_init(SENSE0_DATA_PIN);
-    gpio_init(SENSE1_DATA_PIN);
+int characterise_trims(uint8_t margin, uint8_t bad_mask[64]) {
+    int bad = 0;
 
-    gpio_put(IHB0_EN_PIN, false);
-    gpio_put(IHB0_DIR_PIN, false);
-    gpio_put(IHB1_EN_PIN, false);
-    gpio_put(IHB1_DIR_PIN, false);
-    gpio_put(SENSE_RST_PIN, false);
-    gpio_put(ADDR_X0_PIN, false);
-    gpio_put(ADDR_X1_PIN, false);
-    gpio_put(ADDR_X2_PIN, false);
-    gpio_put(ADDR_X3_PIN, false);
-    gpio_put(ADDR_Y0_PIN, false);
-    gpio_put(ADDR_Y1_PIN, false);
-    gpio_put(ADDR_Y2_PIN, false);
-    gpio_put(ADDR_Y3_PIN, false);
-    gpio_put(X_EN_PIN, false);
-    gpio_put(X_DIR_PIN, false);
-    gpio_put(Y_EN_PIN, false);
-    gpio_put(Y_DIR_PIN, false);
-    gpio_put(DEBUG_EVENT_PIN, false);
+    // Never trim the saturation below 10ns, and leave room for the margin
+    int min_trim = 1 - core_timing.saturation / 10;
+    if (min_trim < -128) min_trim = -128;
+    int max_trim = 127 - margin;
 
-    gpio_set_dir(IHB0_EN_PIN, GPIO_OUT);
-    gpio_set_dir(IHB0_DIR_PIN, GPIO_OUT);
-    gpio_set_dir(IHB1_EN_PIN, GPIO_OUT);
-    gpio_set_dir(IHB1_DIR_PIN, GPIO_OUT);
-    gpio_set_dir(SENSE_RST_PIN, GPIO_OUT);
-    gpio_set_dir(ADDR_X0_PIN, GPIO_OUT);
-    gpio_set_dir(ADDR_X1_PIN, GPIO_OUT);
-    gpio_set_dir(ADDR_X2_PIN, GPIO_OUT);
-    gpio_set_dir(ADDR_X3_PIN, GPIO_OUT);
-    gpio_set_dir(ADDR_Y0_PIN, GPIO_OUT);
-    gpio_set_dir(ADDR_Y1_PIN, GPIO_OUT);
-    gpio_set_dir(ADDR_Y2_PIN, GPIO_OUT);
-    gpio_set_dir(ADDR_Y3_PIN, GPIO_OUT);
-    gpio_set_dir(X_EN_PIN, GPIO_OUT);
-    gpio_set_dir(X_DIR_PIN, GPIO_OUT);
-    gpio_set_dir(Y_EN_PIN, GPIO_OUT);
-    gpio_set_dir(Y_DIR_PIN, GPIO_OUT);
-    gpio_set_dir(DEBUG_EVENT_PIN, GPIO_OUT);
+    // Same for the recovery
+    int min_settle = 1 - core_timing.recovery / 10;
+    if (min_settle < -128) min_settle = -128;
 
+    for (int i = 0; i < 64; i++) {
+        bad_mask[i] = 0;
+    }
 
-    gpio_set_dir(SENSE0_DATA_PIN, GPIO_IN);
-    gpio_set_dir(SENSE1_DATA_PIN, GPIO_IN);
+    write_all(0);
 
-    
-    //std::bitset<8> x1(*val1);
-    //std::cout << x1 << '\n';
-
-    int total_test_cnt = 0;
-    int gallop_test_fail_cnt = 0;
-    int full_current_test_fail_cnt = 0;
-    int image_test_fail_cnt = 0;
-
-    while (true) {
-        printf("Perfoming the test\n");
-        total_test_cnt++;
-        //core_response_test();
-        //half_current_core_response_test();
-        //sleep_ms(1);
-        //core_response_with_inhibit_test();
-        //basic_core_response_test();
-        
-        //write_all(1);
-        //dump_memory();
-
-        //write_all(0);
-        //dump_memory();
-        /*write_smiley(true);
-        dump_memory();
-
-        write_blocky(false);
-        dump_memory();
-
-        write_smiley(false);
-        dump_memory();
-
-        dump_memory_debug_setpoint();
-
-        //dump_memory_compare_smiley();
-
-        write_blocky(true);
-        dump_memory();
-
-         
-        sleep_ms(3000);*/
-
-        int failures = 0;
-        int total_reads = 256*256*8;
-        
-        failures += mem_test_gallop(0b00, 0b00);
-        failures += mem_test_gallop(0b00, 0b01);
-        failures += mem_test_gallop(0b00, 0b10);
-        failures += mem_test_gallop(0b00, 0b11);
-        failures += mem_test_gallop(0b11, 0b00);
-        failures += mem_test_gallop(0b11, 0b01);
-        failures += mem_test_gallop(0b11, 0b10);
-        failures += mem_test_gallop(0b11, 0b11);
-        
-        if(failures > 0) gallop_test_fail_cnt++;
-        std::cout << "Full gallop test complete, num failures: " << failures << " out of " << total_reads << " reads \n";
-
-        int failures2 = 0;
-        failures2 += mem_test_half_current();
-        int total_reads2 = 256*256;
-        if(failures2 > 0) full_current_test_fail_cnt++;
-        std::cout << "Full half current test complete, num failures: " << failures2 << " out of " << total_reads2 << " reads \n";
-
-        int failures3  = 0;
-        failures3 += mem_test_image();
-        int total_reads3 = 256*128;
-        if(failures3 > 0) image_test_fail_cnt++;
-        std::cout << "Image test complete, num failures: " << failures3 << " out of " << total_reads3 << " reads \n";
-
-        std::cout << '\n';
-        std::cout << "Summary: \n";
-        std::cout << "total test performed: " << total_test_cnt << "\n";
-        std::cout << "gallop_test_fail_cnt: " << gallop_test_fail_cnt << "\n";
-        std::cout << "full_current_test_fail_cnt: " << full_current_test_fail_cnt << "\n";
-        std::cout << "image_test_fail_cnt: " << image_test_fail_cnt << "\n";
-        
-        std::cout << '\n';
-        std::cout << '\n';
-    }
-}
\ No newline at end of file
+    for (int address = 0; address < 256; ++address) {
+        core_trim.saturation[address] = max_trim;
+        core_trim.settle[address] = max_trim;
+        update_address_cycles(address);
+        uint8_t failed = trim_probe(address);
+        if (failed) {
+            // Even the longest pulse does not work, keep the default timing for this address
+            core_trim.saturation[address] = 0;
+            core_trim.settle[address] = 0;
+            update_address_cycles(address);
+            bad_mask[address >> 2] |= failed << ((address & 0b11) << 1);
+            bad++;
+            continue;
+        }
+
+        // Binary search for the shortest saturation time which still passes
+        int lo = min_trim;
+        int hi = max_trim;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            core_trim.saturation[address] = mid;
+            update_address_cycles(address);
+            if (trim_probe(address)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        core_trim.saturation[address] = lo + margin;
+        update_address_cycles(address);
+        telemetry_emit(EVENT_TIMING, TIMING_SATURATION, address, core_timing.saturation + core_trim.saturation[address] * 10, 0);
+
+        // Then for the shortest recovery after its pulses, the probe passed with the longest one
+        lo = min_settle;
+        hi = max_trim;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            core_trim.settle[address] = mid;
+            update_address_cycles(address);
+            if (trim_probe(address)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        core_trim.settle[address] = lo + margin;
+        update_address_cycles(address);
+        telemetry_emit(EVENT_TIMING, TIMING_SETTLE, address, core_timing.recovery + core_trim.settle[address] * 10, 0);
+    }
+
+    write_all(0);
+
+    return bad;
+}
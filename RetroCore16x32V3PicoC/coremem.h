@@ -0,0 +1,278 @@
+#pragma once
+
+#include <stdint.h>
+
+/* The code makes use of some bitwise operations, and assumes that the pins are in consecutive order
+do not change these pins*/
+
+#define IHB0_EN_PIN 0
+#define IHB0_DIR_PIN 1
+#define IHB1_EN_PIN 2
+#define IHB1_DIR_PIN 3
+#define SENSE_RST_PIN 4
+
+#define ADDR_X0_PIN 5
+#define ADDR_X1_PIN 6
+#define ADDR_X2_PIN 7
+#define ADDR_X3_PIN 8
+#define ADDR_Y0_PIN 9
+#define ADDR_Y1_PIN 10
+#define ADDR_Y2_PIN 11
+#define ADDR_Y3_PIN 12
+
+#define X_EN_PIN 13
+#define X_DIR_PIN 14
+#define Y_EN_PIN 15
+#define Y_DIR_PIN 16
+#define DEBUG_EVENT_PIN 17
+
+#define SENSE0_DATA_PIN 18
+#define SENSE1_DATA_PIN 19
+
+/* All delays are given in nanoseconds and converted to system clock cycles, rounding up.
+When the build fixes the clock with COREMEM_SYS_CLOCK_KHZ (see CMakeLists.txt) the conversion happens at compile time,
+otherwise it follows clock_get_hz(clk_sys) as read by coremem_init and coremem_timing_update.*/
+#ifdef COREMEM_SYS_CLOCK_KHZ
+constexpr uint32_t ns_to_cycles(uint32_t ns) {
+    return ((uint64_t)ns * COREMEM_SYS_CLOCK_KHZ + 999999) / 1000000;
+}
+
+constexpr uint32_t cycles_to_ns(uint32_t cycles) {
+    return (uint64_t)cycles * 1000000 / COREMEM_SYS_CLOCK_KHZ;
+}
+#else
+extern uint32_t coremem_sys_clock_khz;
+
+inline uint32_t ns_to_cycles(uint32_t ns) {
+    return ((uint64_t)ns * coremem_sys_clock_khz + 999999) / 1000000;
+}
+
+inline uint32_t cycles_to_ns(uint32_t cycles) {
+    return (uint64_t)cycles * 1000000 / coremem_sys_clock_khz;
+}
+#endif
+
+enum MosfetBridgeState {
+    NONE_CONDUCT_2 = 0b00,
+    CONDUCT_DIR_2 = 0b01,
+    NONE_CONDUCT = 0b10,
+    CONDUCT_DIR_1 = 0b11
+};
+
+// Delays of the drive waveform, in nanoseconds
+struct CoreTiming {
+    uint16_t address_setup;  // address lines settle before any drive is turned on
+    uint16_t inhibit_setup;  // X and inhibit currents settle before the Y drive
+    uint16_t saturation;     // Y drive on time, to fully saturate the selected cores
+    uint16_t y_off_settle;   // Y drive off before the X and inhibit drives are turned off
+    uint16_t recovery;       // all drives off before the next waveform
+    uint16_t cooldown;       // keeps the current limiting resistors from overheating
+};
+
+extern const CoreTiming default_core_timing;
+
+// Timing used by write_memory_waveform, may be replaced by a tuned profile at start-up.
+// Call coremem_timing_update after changing it.
+extern CoreTiming core_timing;
+
+// Per-address adjustment of the saturation and settle (recovery) delays, in units of 10ns
+struct CoreTrim {
+    int8_t saturation[256];
+    int8_t settle[256];
+};
+
+// Trims used by write_memory_waveform, all zero unless filled by characterise_trims or the calibration.
+// Call coremem_timing_update after changing it.
+extern CoreTrim core_trim;
+
+void core_trim_clear();
+
+// Fill the trims from the drive line lengths and the core orientation, the saturation trim of an
+// address is x_trim[xAddress] + y_trim[yAddress] + orientation_trim[invertX], and its settle trim
+// x_settle[xAddress] + y_settle[yAddress]
+void core_trim_from_lines(const int8_t x_trim[16], const int8_t y_trim[16], const int8_t orientation_trim[2],
+                          const int8_t x_settle[16], const int8_t y_settle[16]);
+
+// Setup all the pins used by the controller, and put every drive in a safe (off) state
+void coremem_init();
+
+// Convert core_timing and core_trim to cycles, also picks up a changed system clock
+void coremem_timing_update();
+
+void set_reset_latch(bool state);
+void set_address(uint8_t addr);
+void set_x_drv(MosfetBridgeState state);
+void set_y_drv(MosfetBridgeState state);
+void set_ihb0(MosfetBridgeState state);
+void set_ihb1(MosfetBridgeState state);
+
+// How write_memory_waveform runs the waveform, a combination of the flags below
+enum WaveformMode : uint8_t {
+    WAVEFORM_NORMAL = 0,
+    WAVEFORM_CRITICAL = 1, // with interrupts masked, so nothing can stretch a phase
+    WAVEFORM_MEASURE = 2,  // record the phase durations in waveform_jitter
+};
+
+extern uint8_t waveform_mode;
+
+// The phases of a waveform, between the pin changes
+enum WaveformPhase {
+    PHASE_ADDRESS_SETUP = 0, // address set, until the X and inhibit drives are on
+    PHASE_INHIBIT_SETUP,     // until the Y drive is on
+    PHASE_SATURATION,        // until the Y drive is off
+    PHASE_Y_OFF_SETTLE,      // until the X and inhibit drives are off
+    PHASE_RECOVERY,          // recovery and cooldown
+    PHASE_COUNT
+};
+
+#define JITTER_BINS 16
+
+/* Cycles a phase took beyond its delay, measured with SysTick. The smallest excess is the fixed cost
+of the pin updates, anything above that is jitter from interrupts and flash stalls.*/
+struct PhaseJitter {
+    uint32_t samples;
+    uint32_t max_excess;
+    uint32_t histogram[JITTER_BINS]; // bin 0: no excess, bin n: below 2^n cycles, the last bin: anything longer
+};
+
+extern PhaseJitter waveform_jitter[PHASE_COUNT];
+
+void waveform_jitter_clear();
+
+// Log the non-empty histogram bins as telemetry
+void waveform_jitter_report();
+
+void write_memory_waveform(uint8_t address, bool dir, uint8_t enable_mask, bool reset_latch);
+void write_memory(uint8_t address, uint8_t value);
+uint8_t read_memory(uint8_t address);
+
+/* How read_memory samples the sense latches after the read pulse. With more than one sample they
+are spread evenly over the window and each bit is decided by majority, a bit which did not read
+the same every time makes it a weak read. A single sample (the default) adds no time to a read.
+Call coremem_timing_update after changing it, which also limits the samples to SENSE_MAX_SAMPLES
+(EVENT_WEAK_READ counts them in 4 bits).*/
+#define SENSE_MAX_SAMPLES 15
+
+struct SenseConfig {
+    uint8_t samples;
+    uint16_t window_ns;
+};
+
+struct SenseStats {
+    uint32_t reads;
+    uint32_t weak_reads;
+    uint32_t weak_bits[2];
+};
+
+extern SenseConfig sense_config;
+extern SenseStats sense_stats;
+
+// Weak reads per address, saturating, an early warning of cores drifting towards failure
+extern uint8_t sense_weak_reads[256];
+
+void sense_stats_clear();
+
+// Diagnostic pulse programs on core 0 (see waveform_program.h), for looking at the sense lines with a scope.
+// They return false if the program was rejected by the load checks.
+bool basic_core_response_test();
+bool half_current_core_response_test();
+bool core_response_test();
+bool core_response_with_inhibit_test();
+
+void write_all(bool value);
+void dump_memory();
+void dump_memory_compare_smiley();
+void dump_memory_debug_setpoint();
+void write_blocky(bool right);
+void write_smiley(bool right);
+void draw_image_8x8(uint8_t startX, uint8_t startY, const uint8_t img[8][8]);
+
+extern const uint8_t smiley_16x16[16][16];
+extern const uint8_t blocky[16][16];
+extern const uint8_t smiley_8x8[8][8];
+extern const uint8_t stripey_8x8[8][8];
+extern const uint8_t triangular_8x8[8][8];
+extern const uint8_t cross_8x8[8][8];
+
+// Cores which read back wrong in one of the tests below since failed_cores_clear, 1 bit per core,
+// bit 0 and bit 1 of an address are adjacent bits (as in the bad_mask of characterise_trims)
+extern uint8_t failed_cores[64];
+
+void failed_cores_clear();
+
+// With restore, the background is put back from the tracked snapshot (see plane_snapshot.h)
+// instead of rewriting the whole plane
+int mem_test_gallop_internal(uint8_t test_address, uint8_t default_pattern, uint8_t bit_pattern, bool restore = false);
+int mem_test_gallop(uint8_t default_pattern, uint8_t bit_pattern);
+int mem_test_half_current_internal(uint8_t test_address, bool restore = false);
+int mem_test_half_current();
+
+// Pulses per address, the same as mem_test_half_current
+#define DISTURB_PULSES 2048
+
+// A pulse which writes bit 0 of an address with bit 1 inhibited half selects, in bit plane 0, the
+// other cores on its X and Y lines. In bit plane 1 it half selects every core: the ones off its
+// lines see the inhibit current alone, its own core sees X + Y - inhibit, and on its lines the
+// line and inhibit currents cancel out. So the bit 1 cores collect the disturb of all the pulses
+// until they are read back.
+#define DISTURB_INHIBITED 256
+
+// Most addresses whose line read back is put off, they are on one diagonal of the plane
+#define DISTURB_MAX_BATCH 16
+
+struct DisturbResult {
+    uint32_t pulses;
+    uint32_t exposures;         // half selected cores times the read backs which checked them
+    uint32_t failures;
+    uint32_t failing_addresses; // pulsed addresses whose read back found a disturbed core
+    float failure_rate_bound;   // upper bound of failures per exposure, at 95% confidence
+
+    // Schedule of the read backs, zero at the start of a pass
+    uint16_t batch_rows;        // Y lines of the addresses pulsed since the last read back
+    uint8_t batch_diagonal;
+    uint8_t batch_count;
+    uint8_t batch_shift;        // log2 of the addresses to pulse before the next read back
+    bool plane_unchecked;       // pulses since the whole plane was last read back
+};
+
+// Faster version of mem_test_half_current, with the same DISTURB_PULSES pulses per address. The
+// lines of a pulsed address are read back, and the rest of the plane only when they failed, so
+// the failure is tied to the address. While the read backs come out clean they are put off for
+// more and more addresses of a diagonal (1, 2, 4 up to DISTURB_MAX_BATCH), which share no line,
+// and one read back of their lines checks them all; a failure goes back to reading after every
+// address. The whole plane is read once at the end, which also catches the bit 1 cores.
+//
+// A core where the X line of one batched address crosses the Y line of another gets the pulses
+// of both, so batching stresses it harder than mem_test_half_current, never less.
+//
+// Disturb builds up until a core is read, so single pulses are not independent trials. An
+// exposure is one half selected core between two read backs: a core of bit plane 0 for every
+// read back of its lines, a core of bit plane 1 for every read back of the whole plane. The
+// bound treats those as the independent trials.
+int mem_test_half_current_adaptive(DisturbResult *result);
+
+// The steps of mem_test_half_current_adaptive, for callers which run it piecewise.
+// An address step needs the plane to hold 0b00 apart from the addresses whose read back is still
+// put off, its counts are added to result. Run them in the order of
+// mem_test_half_current_adaptive_order to get the batches.
+// The check step reads back the open batch and the whole plane, leaving it at 0b00. A caller
+// which has to give up the plane part way through the addresses runs it first, without touching
+// the plane in between. The finish step is the check plus the failure rate bound.
+int mem_test_half_current_adaptive_address(uint8_t test_address, DisturbResult *result);
+int mem_test_half_current_adaptive_check(DisturbResult *result);
+int mem_test_half_current_adaptive_finish(DisturbResult *result);
+
+// The address at index of a pass over first..last_address, one diagonal of the plane after the other
+uint8_t mem_test_half_current_adaptive_order(uint8_t first_address, uint8_t last_address, int index);
+
+// Writes the images which mem_test_image_internal checks
+void mem_test_image_setup();
+int mem_test_image_internal();
+int mem_test_image();
+
+// Find the shortest saturation time at which each address still reads back reliably, and
+// fill core_trim.saturation with it plus the margin (in units of 10ns). Then the same for the
+// recovery time after its waveforms, into core_trim.settle.
+// Addresses which fail even with the longest trim are returned in bad_mask, 2 bits per address.
+// This overwrites the whole memory.
+int characterise_trims(uint8_t margin, uint8_t bad_mask[64]);
@@ -0,0 +1,862 @@
+// Host benchmark of the controller operations against the simulated core plane.
+//
+// For every operation it reports the number of drive waveforms, the modelled drive time of the
+// delay budgets and the resulting operations per second. Results are written as CSV, and when a
+// baseline is given the run fails if any operation needs more waveforms or more drive time.
+//
+// usage: coremem_bench [--csv <results.csv>] [--baseline <baseline.csv>]
+
+#include <string.h>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "pico/stdlib.h"
+#include "coremem.h"
+#include "write_buffer.h"
+#include "plane_snapshot.h"
+#include "switching_stats.h"
+#include "core_memory.h"
+#include "waveform_program.h"
+#include "campaign.h"
+#include "command.h"
+#include "telemetry.h"
+#include "calibration.h"
+#include "hardware/flash.h"
+#include "sim_plane.h"
+#include "sim_flash.h"
+
+struct BenchCase {
+    std::string name;
+    int calls;
+    std::function<int()> run; // returns the number of failures
+    std::function<void()> setup = nullptr; // not measured
+    uint32_t sys_clock_khz = 200000;
+};
+
+static void setup_trims() {
+    uint8_t bad_mask[64];
+    characterise_trims(5, bad_mask);
+}
+
+struct BenchResult {
+    std::string name;
+    uint64_t calls;
+    uint64_t waveforms;
+    uint64_t drive_ns;
+    double ops_per_s;
+    uint64_t failures;
+};
+
+// Move the pending telemetry out, keeping the last event of a type. Returns false if there was none.
+static bool last_event(uint8_t type, TelemetryEvent *found) {
+    uint8_t payload[PROTOCOL_RESPONSE_HEADER + 16 * TELEMETRY_EVENT_SIZE];
+    bool seen = false;
+    uint32_t length;
+    while ((length = telemetry_fill(payload, sizeof(payload))) != 0) {
+        for (uint32_t offset = PROTOCOL_RESPONSE_HEADER; offset < length; offset += TELEMETRY_EVENT_SIZE) {
+            TelemetryEvent event;
+            telemetry_decode(payload + offset, &event);
+            if (event.type == type) {
+                *found = event;
+                seen = true;
+            }
+        }
+    }
+    return seen;
+}
+
+// Read an address holding 0b11 with samples of the sense latches inverted, returns the voted value
+static uint8_t read_flipped(uint8_t address, uint8_t samples, uint32_t flips0, uint32_t flips1) {
+    sense_config = {samples, 200};
+    coremem_timing_update();
+    sim_poke(address, 0b11);
+    sim_set_sense_flips(address, flips0, flips1);
+    return read_memory(address);
+}
+
+// Append a request to a request payload, returns its size
+static uint32_t put_request(uint8_t *payload, uint32_t size, uint16_t seq, uint8_t opcode, const uint8_t *data, uint16_t length) {
+    protocol_put_u16(payload + size, seq);
+    payload[size + 2] = opcode;
+    protocol_put_u16(payload + size + 3, length);
+    memcpy(payload + size + PROTOCOL_REQUEST_HEADER, data, length);
+    return size + PROTOCOL_REQUEST_HEADER + length;
+}
+
+// Add a campaign job from its parameters, the progress fields start out cleared
+static int add_job(uint8_t test, uint8_t priority, uint8_t default_pattern, uint8_t bit_pattern, uint8_t first_address,
+                   uint8_t last_address, uint16_t passes) {
+    CampaignJob job = {};
+    job.test = test;
+    job.priority = priority;
+    job.default_pattern = default_pattern;
+    job.bit_pattern = bit_pattern;
+    job.first_address = first_address;
+    job.last_address = last_address;
+    job.passes = passes;
+    return campaign_add(job);
+}
+
+#define CALIBRATION_BENCH_SLOTS ((int)(CALIBRATION_SECTORS * FLASH_SECTOR_SIZE / CALIBRATION_SLOT_SIZE))
+
+static uint32_t calibration_slot_offset(int slot) {
+    return PICO_FLASH_SIZE_BYTES - CALIBRATION_SECTORS * FLASH_SECTOR_SIZE + slot * CALIBRATION_SLOT_SIZE;
+}
+
+static const CalibrationRecord *calibration_slot(int slot) {
+    return (const CalibrationRecord *)sim_flash_data(calibration_slot_offset(slot));
+}
+
+// Save a calibration told apart by its cooldown
+static bool save_calibration(uint16_t cooldown) {
+    calibration_defaults();
+    calibration.timing.cooldown = cooldown;
+    return calibration_save();
+}
+
+// Load it as at start-up, returns the cooldown of the loaded record, -1 if there was none
+static int load_calibration() {
+    return calibration_load() ? calibration.timing.cooldown : -1;
+}
+
+static std::vector<BenchCase> bench_cases() {
+    return {
+        {"write_all", 2, [] {
+            write_all(false);
+            write_all(true);
+            return 0;
+        }},
+        {"dump_memory", 1, [] {
+            dump_memory();
+            return 0;
+        }},
+        {"write_smiley", 2, [] {
+            write_smiley(false);
+            write_smiley(true);
+            return 0;
+        }},
+        {"draw_image_8x8", 4, [] {
+            draw_image_8x8(0, 0, smiley_8x8);
+            draw_image_8x8(8, 0, stripey_8x8);
+            draw_image_8x8(0, 8, triangular_8x8);
+            draw_image_8x8(8, 8, cross_8x8);
+            return 0;
+        }},
+        {"draw_image_8x8_x32", 32, [] {
+            for (int i = 0; i < 32; i++) {
+                draw_image_8x8(0, 0, smiley_8x8);
+            }
+            return 0;
+        }},
+        {"draw_image_8x8_x32_buffered", 32, [] {
+            for (int i = 0; i < 32; i++) {
+                for (int y = 0; y < 8; y++) {
+                    for (int x = 0; x < 8; x++) {
+                        buffered_write((y << 4) | x, smiley_8x8[y][x], 0b01);
+                    }
+                }
+            }
+            write_buffer_flush();
+
+            int failures = 0;
+            for (int y = 0; y < 8; y++) {
+                for (int x = 0; x < 8; x++) {
+                    failures += (read_memory((y << 4) | x) & 0b01) != smiley_8x8[y][x];
+                }
+            }
+            return failures;
+        }},
+        {"buffered_read_before_flush", 1, [] {
+            sim_poke(0x10, 0b10);
+            sim_poke(0x11, 0b10);
+
+            // Bit 0 from the buffer, bit 1 still from the core
+            buffered_write(0x10, 0b01, 0b01);
+            int failures = buffered_read(0x10) != 0b11 || sim_peek(0x10) != 0b10;
+
+            // Two partial writes make a full mask, which is read without touching the cores
+            buffered_write(0x11, 0b01, 0b01);
+            buffered_write(0x11, 0b00, 0b10);
+            uint64_t waveforms = sim_stats().waveforms;
+            failures += buffered_read(0x11) != 0b01 || sim_stats().waveforms != waveforms;
+
+            // A later write to the same bit wins
+            buffered_write(0x10, 0b00, 0b01);
+            failures += buffered_read(0x10) != 0b10;
+
+            failures += write_buffer_pending() != 2;
+            write_buffer_flush();
+            failures += write_buffer_pending() != 0 || sim_peek(0x10) != 0b10 || sim_peek(0x11) != 0b01;
+            return failures;
+        }},
+        {"buffered_write_overflow", WRITE_BUFFER_SIZE + 10, [] {
+            // One address more than the buffer holds flushes it, the rest stays pending
+            int failures = 0;
+            for (int address = 0; address < WRITE_BUFFER_SIZE + 10; address++) {
+                buffered_write(address, address % 3 + 1);
+            }
+            failures += write_buffer_pending() != 10;
+            for (int address = 0; address < WRITE_BUFFER_SIZE + 10; address++) {
+                uint8_t expected = address < WRITE_BUFFER_SIZE ? address % 3 + 1 : 0;
+                failures += sim_peek(address) != expected || buffered_read(address) != address % 3 + 1;
+            }
+
+            write_buffer_flush();
+            for (int address = 0; address < WRITE_BUFFER_SIZE + 10; address++) {
+                failures += sim_peek(address) != address % 3 + 1;
+            }
+            return failures;
+        }},
+        {"snapshot_restore_single", 1, [] {
+            PlaneSnapshot background;
+            snapshot_assume(&background, 0b11);
+            write_memory(0x37, 0b01);
+            snapshot_restore();
+            snapshot_release();
+            return read_memory(0x37) != 0b11;
+        }, [] { write_all(true); }},
+        {"snapshot_capture_restore", 1, [] {
+            PlaneSnapshot background;
+            snapshot_capture(&background);
+
+            // Every change of value, so restoring needs the clear pulse, the set pulse or both
+            int failures = 0;
+            int expected_pulses = 0;
+            for (int address = 0; address < 256; address += 7) {
+                uint8_t before = sim_peek(address);
+                uint8_t after = before ^ (address % 3 + 1);
+                write_memory(address, after);
+                expected_pulses += ((before & ~after) != 0) + ((after & ~before) != 0);
+            }
+            // Written back to its own value, nothing to restore
+            write_memory(0x41, 0b10);
+            write_memory(0x41, snapshot_get(background.image, 0x41));
+            failures += snapshot_dirty_count() != 37;
+
+            failures += snapshot_restore() != expected_pulses;
+            failures += snapshot_dirty_count() != 0;
+            snapshot_release();
+
+            for (int address = 0; address < 256; address++) {
+                failures += sim_peek(address) != snapshot_get(background.image, address) ||
+                            snapshot_get(background.image, address) != ((address * 5 + (address >> 2)) & 0b11);
+            }
+            return failures;
+        }, [] {
+            for (int address = 0; address < 256; address++) {
+                sim_poke(address, (address * 5 + (address >> 2)) & 0b11);
+            }
+        }},
+        {"core_memcpy_64", 2, [] {
+            uint8_t data[CORE_MEMORY_SIZE];
+            uint8_t read_back[CORE_MEMORY_SIZE];
+            for (int i = 0; i < CORE_MEMORY_SIZE; i++) {
+                data[i] = i * 37 + 11;
+            }
+
+            core_memcpy_to(0, data, sizeof(data));
+            core_memcpy_from(read_back, 0, sizeof(read_back));
+
+            int failures = 0;
+            for (int i = 0; i < CORE_MEMORY_SIZE; i++) {
+                failures += read_back[i] != data[i];
+            }
+            return failures;
+        }},
+        {"core_memset_memcmp_64", 2, [] {
+            uint8_t zeros[CORE_MEMORY_SIZE] = {};
+            core_memset(0, 0, CORE_MEMORY_SIZE);
+
+            // The first compare has to stop at the first word
+            zeros[0] = 0x40;
+            int failures = core_memcmp(0, zeros, CORE_MEMORY_SIZE) >= 0;
+            zeros[0] = 0;
+            failures += core_memcmp(0, zeros, CORE_MEMORY_SIZE) != 0;
+            return failures;
+        }},
+        {"dump_memory_oversampled", 1, [] {
+            sense_config = {5, 200};
+            coremem_timing_update();
+            sense_stats_clear();
+            dump_memory();
+            int failures = sense_stats.weak_reads;
+            sense_config = {1, 0};
+            coremem_timing_update();
+            return failures;
+        }, [] { write_smiley(false); }},
+        {"read_memory_weak", 3, [] {
+            int failures = 0;
+            TelemetryEvent event;
+            sense_stats_clear();
+            last_event(EVENT_WEAK_READ, &event);
+
+            // 2 of 5 samples of bit 0 read 0, the majority holds
+            failures += read_flipped(0x21, 5, 0b00101, 0) != 0b11;
+            failures += sense_stats.weak_reads != 1 || sense_stats.weak_bits[0] != 1 || sense_stats.weak_bits[1] != 0;
+            failures += !last_event(EVENT_WEAK_READ, &event) || event.id != (3 | (5 << 4)) || event.extra != 0b11;
+
+            // Ties go to the last sample
+            failures += read_flipped(0x21, 4, 0b0011, 0b1100) != 0b01;
+            failures += sense_stats.weak_reads != 2 || sense_stats.weak_bits[0] != 2 || sense_stats.weak_bits[1] != 1;
+            failures += sense_weak_reads[0x21] != 2;
+
+            // The samples are limited to what the event can count
+            failures += read_flipped(0x21, 20, 0b1, 0) != 0b11;
+            failures += sense_config.samples != SENSE_MAX_SAMPLES;
+            failures += !last_event(EVENT_WEAK_READ, &event) || event.id != (14 | (15 << 4)) || event.value != 15;
+
+            sense_config = {1, 0};
+            coremem_timing_update();
+            return failures;
+        }},
+        {"mem_test_gallop", 8, [] {
+            int failures = 0;
+            failures += mem_test_gallop(0b00, 0b00);
+            failures += mem_test_gallop(0b00, 0b01);
+            failures += mem_test_gallop(0b00, 0b10);
+            failures += mem_test_gallop(0b00, 0b11);
+            failures += mem_test_gallop(0b11, 0b00);
+            failures += mem_test_gallop(0b11, 0b01);
+            failures += mem_test_gallop(0b11, 0b10);
+            failures += mem_test_gallop(0b11, 0b11);
+            return failures;
+        }},
+        {"mem_test_half_current", 1, [] {
+            return mem_test_half_current();
+        }},
+        {"mem_test_half_current_adaptive", 1, [] {
+            DisturbResult result;
+            int failures = mem_test_half_current_adaptive(&result);
+
+            // Every address gets the full count. The read backs are put off for 1, 2, 4 and 8
+            // addresses, the rest of the first diagonal and then a whole diagonal at a time; each
+            // exposes the bit 0 cores on the lines of its n addresses, and the pass every bit 1 core.
+            auto line_cores = [](int n) { return 32 * n - n * n - n; };
+            uint32_t exposures = line_cores(1) + line_cores(2) + line_cores(4) + line_cores(8) + line_cores(1) +
+                                 15 * line_cores(16) + DISTURB_INHIBITED;
+            failures += result.pulses != 256 * DISTURB_PULSES;
+            failures += result.exposures != exposures || result.failing_addresses != 0;
+            return failures;
+        }},
+        {"mem_test_half_current_adaptive_failure", 1, [] {
+            // A core which never switches fails the read back of its diagonal, whose addresses
+            // all count, and the next diagonal is read back after 1, 2, 4 and 8 addresses again
+            sim_set_switch_time_ns(0x35, 1000000);
+            DisturbResult result;
+            int failures = mem_test_half_current_adaptive(&result) != 1;
+
+            auto line_cores = [](int n) { return 32 * n - n * n - n; };
+            uint32_t exposures = 2 * (line_cores(1) + line_cores(2) + line_cores(4) + line_cores(8) + line_cores(1)) +
+                                 14 * line_cores(16) + DISTURB_INHIBITED;
+            failures += result.exposures != exposures || result.failing_addresses != DISTURB_MAX_BATCH;
+            return failures;
+        }},
+        {"mem_test_image", 1, [] {
+            return mem_test_image();
+        }},
+        {"command_response_overflow", 1, [] {
+            // Six whole-plane block reads, only five of their responses fit in a response payload
+            static uint8_t request[PROTOCOL_MAX_PAYLOAD];
+            static uint8_t response[PROTOCOL_MAX_PAYLOAD];
+            const uint8_t block[3] = {0, 0x00, 0x01};
+            uint32_t size = 0;
+            for (uint16_t seq = 0; seq < 6; seq++) {
+                size = put_request(request, size, seq, CMD_READ_BLOCK, block, sizeof(block));
+            }
+            size = put_request(request, size, 6, CMD_WRITE_ALL, block, 1);
+
+            // Every request is answered once, in order, spread over two payloads
+            int failures = 0;
+            uint16_t next_seq = 0;
+            int payloads = 0;
+            uint32_t consumed = 0;
+            uint32_t length;
+            while ((length = command_execute(request, size, &consumed, response, sizeof(response))) != 0) {
+                payloads++;
+                for (uint32_t offset = 0; offset < length;) {
+                    failures += protocol_get_u16(response + offset) != next_seq++ || response[offset + 3] != STATUS_OK;
+                    offset += PROTOCOL_RESPONSE_HEADER + protocol_get_u16(response + offset + 4);
+                }
+            }
+            failures += next_seq != 7 || payloads != 2 || consumed != size;
+
+            // A response which does not even fit on its own
+            static uint8_t ping[PROTOCOL_MAX_PAYLOAD];
+            size = put_request(request, 0, 7, CMD_PING, ping, PROTOCOL_MAX_PAYLOAD - PROTOCOL_REQUEST_HEADER);
+            consumed = 0;
+            length = command_execute(request, size, &consumed, response, sizeof(response));
+            failures += length != PROTOCOL_RESPONSE_HEADER || response[3] != STATUS_NO_SPACE || consumed != size;
+            failures += command_execute(request, size, &consumed, response, sizeof(response)) != 0;
+            return failures;
+        }},
+        {"campaign_default", 1, [] {
+            campaign_load_default();
+            campaign_start(0, 0);
+            while (campaign_step()) {
+            }
+
+            int failures = campaign_state() != CAMPAIGN_FINISHED;
+            for (int i = 0; i < campaign_job_count(); i++) {
+                failures += campaign_job(i).failures;
+            }
+            return failures;
+        }},
+        {"campaign_interleaved_resume", 1, [] {
+            campaign_clear();
+            add_job(TEST_GALLOP, 1, 0b00, 0b01, 0, 127, 1);
+            add_job(TEST_GALLOP, 1, 0b11, 0b10, 128, 255, 1);
+            add_job(TEST_HALF_CURRENT, 1, 0, 0, 0, 15, 1);
+            add_job(TEST_IMAGE, 0, 0, 0, 0, 0, 16);
+
+            // Run out of time part way, then carry on without a limit
+            campaign_start(100000, 0);
+            while (campaign_step()) {
+            }
+            int failures = campaign_state() != CAMPAIGN_EXPIRED || campaign_job(0).steps == 0 || campaign_job(1).steps == 0;
+            campaign_resume(0);
+            while (campaign_step()) {
+            }
+
+            failures += campaign_state() != CAMPAIGN_FINISHED;
+            for (int i = 0; i < campaign_job_count(); i++) {
+                const CampaignJob &job = campaign_job(i);
+                failures += job.failures + (job.steps != campaign_total_steps(job));
+            }
+            return failures;
+        }},
+        {"campaign_adaptive_interrupted", 1, [] {
+            campaign_clear();
+            add_job(TEST_HALF_CURRENT_ADAPTIVE, 1, 0, 0, 0, 255, 1);
+            add_job(TEST_GALLOP, 1, 0b11, 0b00, 0, 255, 1);
+
+            // The gallop job has the same priority, but has to wait for the end of the pass
+            campaign_start(0, 0);
+            campaign_step();
+            campaign_step();
+            int failures = campaign_job(0).steps != 2 * CAMPAIGN_SLICE_STEPS || campaign_job(1).steps != 0;
+
+            // A disturbed core, then a host rewrites the plane part way through the pass
+            sim_poke(0x00, 0b10);
+            campaign_background_lost();
+            write_all(true);
+            while (campaign_step()) {
+            }
+
+            failures += campaign_state() != CAMPAIGN_FINISHED;
+            failures += campaign_job(0).failures != 1 || campaign_job(1).failures != 0;
+            return failures;
+        }},
+        {"campaign_bad_cores", 2, [] {
+            sim_flash_reset();
+            calibration_defaults();
+            // A pair of cores which never switches
+            sim_set_switch_time_ns(0x42, 1000000);
+            campaign_clear();
+            add_job(TEST_GALLOP, 1, 0b00, 0b11, 0x40, 0x4F, 1);
+
+            // The first run finds them and keeps them in the calibration
+            campaign_start(0, 0);
+            while (campaign_step()) {
+            }
+            int failures = campaign_job(0).failures == 0 || campaign_job(0).new_bad != 2 || campaign_job(0).known_bad != 0;
+            failures += !calibration_load() || !calibration_is_bad(0x42, 0) || !calibration_is_bad(0x42, 1);
+            int bad = 0;
+            for (int core = 0; core < 512; core++) {
+                bad += calibration_is_bad(core >> 1, core & 1);
+            }
+            failures += bad != 2;
+
+            // The next run flags them as known, and has nothing new to save
+            uint32_t programs = sim_flash_stats().programs;
+            campaign_start(0, 0);
+            while (campaign_step()) {
+            }
+            failures += campaign_job(0).new_bad != 0 || campaign_job(0).known_bad != 2;
+            failures += sim_flash_stats().programs != programs;
+
+            campaign_clear();
+            calibration_defaults();
+            return failures;
+        }},
+        {"campaign_long_budget", 1, [] {
+            campaign_clear();
+            add_job(TEST_GALLOP, 1, 0b00, 0b01, 0x40, 0x5F, 1);
+
+            // A budget of more than 2^32 us, about 72 minutes, over the command protocol
+            static uint8_t request[PROTOCOL_MAX_PAYLOAD];
+            static uint8_t response[PROTOCOL_MAX_PAYLOAD];
+            uint8_t start[9];
+            protocol_put_u64(start, (1ull << 32) + 1);
+            start[8] = 0;
+            uint32_t size = put_request(request, 0, 0, CMD_CAMPAIGN_START, start, sizeof(start));
+            uint32_t consumed = 0;
+            command_execute(request, size, &consumed, response, sizeof(response));
+            campaign_step();
+            campaign_step();
+            int failures = response[3] != STATUS_OK || campaign_state() != CAMPAIGN_RUNNING;
+
+            size = put_request(request, 0, 1, CMD_CAMPAIGN_STATUS, start, 0);
+            consumed = 0;
+            uint32_t length = command_execute(request, size, &consumed, response, sizeof(response));
+            const uint8_t *status = response + PROTOCOL_RESPONSE_HEADER;
+            failures += length != PROTOCOL_RESPONSE_HEADER + 11 + 12 || status[2] != 1;
+            failures += protocol_get_u64(status + 3) != campaign_run_us() || campaign_run_us() == 0;
+            failures += protocol_get_u32(status + 11) != campaign_job(0).steps;
+
+            campaign_clear();
+            return failures;
+        }},
+        {"calibration_rotation", 3 * CALIBRATION_BENCH_SLOTS, [] {
+            sim_flash_reset();
+            int failures = load_calibration() != -1;
+
+            for (int i = 0; i < 3 * CALIBRATION_BENCH_SLOTS; i++) {
+                // The record being replaced has to survive the save, only the other sector may be erased
+                int previous = i ? (i - 1) % CALIBRATION_BENCH_SLOTS : -1;
+                CalibrationRecord kept;
+                if (previous >= 0) {
+                    memcpy(&kept, calibration_slot(previous), sizeof(kept));
+                }
+
+                failures += !save_calibration(i);
+                if (previous >= 0) {
+                    failures += memcmp(&kept, calibration_slot(previous), sizeof(kept)) != 0;
+                }
+                failures += calibration_slot(i % CALIBRATION_BENCH_SLOTS)->sequence != (uint32_t)i;
+                failures += load_calibration() != i;
+            }
+
+            // The slots wrap around, every sector is erased once per round after the first
+            failures += sim_flash_stats().erases != 2 * CALIBRATION_SECTORS;
+            return failures;
+        }},
+        {"calibration_corrupt_newest", 5, [] {
+            sim_flash_reset();
+            int failures = 0;
+            for (int i = 0; i < 3; i++) {
+                failures += !save_calibration(i);
+            }
+
+            // A flipped bit in the newest record, the one before it takes over
+            sim_flash_data(calibration_slot_offset(2) + offsetof(CalibrationRecord, timing))[0] ^= 0x01;
+            failures += load_calibration() != 1;
+            failures += !save_calibration(3) || load_calibration() != 3 || calibration.sequence != 2;
+
+            // The sequence numbers wrap around
+            sim_flash_reset();
+            calibration_defaults();
+            calibration.timing.cooldown = 7;
+            calibration.sequence = UINT32_MAX;
+            calibration.crc = calibration_crc32((const uint8_t *)&calibration, offsetof(CalibrationRecord, crc));
+            memcpy(sim_flash_data(calibration_slot_offset(0)), &calibration, sizeof(calibration));
+            failures += load_calibration() != 7;
+            failures += !save_calibration(8) || load_calibration() != 8 || calibration.sequence != 0;
+            return failures;
+        }},
+        {"calibration_power_cut", 10, [] {
+            sim_flash_reset();
+            int failures = !save_calibration(0) || !save_calibration(1);
+
+            // Power lost part way through programming the next slot
+            sim_flash_cut_power_after(100);
+            failures += save_calibration(2);
+            sim_flash_power_on();
+            failures += load_calibration() != 1;
+            failures += !save_calibration(3) || load_calibration() != 3;
+
+            // Fill up to the last slot, so the next save erases the first sector
+            for (int i = 4; i < 7; i++) {
+                failures += !save_calibration(i);
+            }
+            failures += calibration_slot(CALIBRATION_BENCH_SLOTS - 1)->sequence != 5;
+
+            // Power lost part way through that erase
+            sim_flash_cut_power_after(FLASH_SECTOR_SIZE / 2);
+            failures += save_calibration(7);
+            sim_flash_power_on();
+            failures += load_calibration() != 6;
+            failures += !save_calibration(8) || load_calibration() != 8;
+            return failures;
+        }},
+        {"diagnostic_programs", 4, [] {
+            int failures = !basic_core_response_test();
+            failures += !half_current_core_response_test();
+            failures += !core_response_test();
+            failures += !core_response_with_inhibit_test();
+            return failures;
+        }},
+        {"waveform_program_limits", 6, [] {
+            const WavePins x_on = wave_x_drv(MosfetBridgeState::CONDUCT_DIR_1);
+            const WavePins x_off = wave_x_drv(MosfetBridgeState::NONE_CONDUCT);
+            const WaveformStep drive_too_long[] = {wave_step(x_on, 6000), wave_step(x_off, 500), wave_end()};
+            const WaveformStep no_cooldown[] = {
+                wave_step(x_on, 1000), wave_step(x_off, 100), wave_step(x_on, 1000), wave_step(x_off, 500), wave_end(),
+            };
+            const WaveformStep loop_no_cooldown[] = {
+                wave_loop(4), wave_step(x_on, 1000), wave_step(x_off, 100), wave_end_loop(), wave_end(),
+            };
+            const WaveformStep loop_drive_on[] = {
+                wave_step(x_on, 100), wave_loop(4), wave_step(wave_none(), 100), wave_end_loop(),
+                wave_step(x_off, 500), wave_end(),
+            };
+            const WaveformStep too_slow[] = {
+                wave_loop(1000), wave_loop(1000), wave_step(wave_none(), 1000), wave_end_loop(), wave_end_loop(), wave_end(),
+            };
+            const WaveformStep empty_loops[] = {
+                wave_loop(65535), wave_loop(65535), wave_loop(65535), wave_end_loop(), wave_end_loop(), wave_end_loop(), wave_end(),
+            };
+
+            // Nothing of a rejected program runs
+            int failures = waveform_execute(drive_too_long, 3);
+            failures += waveform_execute(no_cooldown, 5);
+            failures += waveform_execute(loop_no_cooldown, 5);
+            failures += waveform_execute(loop_drive_on, 6);
+            failures += waveform_execute(too_slow, 6);
+            failures += waveform_execute(empty_loops, 7);
+            return failures;
+        }},
+        {"characterise_trims", 1, [] {
+            uint8_t bad_mask[64];
+            int failures = characterise_trims(5, bad_mask);
+
+            // The modelled lines recover well within the default recovery, the far ends take longest
+            for (int address = 0; address < 256; address++) {
+                failures += core_trim.settle[address] >= 0;
+            }
+            failures += core_trim.settle[0xFF] <= core_trim.settle[0x00];
+            return failures;
+        }},
+        {"core_trim_from_lines", 1, [] {
+            // Lines long enough at both ends of the range to clamp, and an orientation term which
+            // tells the two winding directions apart
+            int8_t x_trim[16], y_trim[16], x_settle[16], y_settle[16];
+            const int8_t orientation_trim[2] = {-3, 4};
+            for (int i = 0; i < 16; i++) {
+                x_trim[i] = -100 + i * 13;
+                y_trim[i] = -90 + i * 12;
+                x_settle[i] = 70 - i * 10;
+                y_settle[i] = 60 - i * 9;
+            }
+            core_trim_from_lines(x_trim, y_trim, orientation_trim, x_settle, y_settle);
+
+            int failures = 0;
+            for (int address = 0; address < 256; address++) {
+                int xAddress = address & 0xF;
+                int yAddress = address >> 4;
+                int saturation = x_trim[xAddress] + y_trim[yAddress] + orientation_trim[(xAddress + yAddress) % 2];
+                int settle = x_settle[xAddress] + y_settle[yAddress];
+                saturation = saturation > 127 ? 127 : saturation < -128 ? -128 : saturation;
+                settle = settle > 127 ? 127 : settle < -128 ? -128 : settle;
+                failures += core_trim.saturation[address] != saturation || core_trim.settle[address] != settle;
+            }
+
+            // Both clamps and both orientations are covered
+            failures += core_trim.saturation[0x00] != -128 || core_trim.saturation[0xFF] != 127;
+            failures += core_trim.settle[0x00] != 127 || core_trim.settle[0xFF] != -128;
+            failures += core_trim.saturation[0x89] - core_trim.saturation[0x88] != 13 + 4 + 3;
+
+            core_trim_clear();
+            return failures;
+        }},
+        {"characterise_switching", 1, [] {
+            int failures = 0;
+
+            // The captured edges have to match the modelled switching times, to within a clock cycle
+            for (int address = 0; address < 256; address++) {
+                SwitchingStats stats[2];
+                failures += characterise_switching_address(address, 1, stats);
+
+                for (int bit = 0; bit < 2; bit++) {
+                    int32_t error = switching_mean_ns(stats[bit]) - sim_switch_time_ns(address);
+                    int32_t min_error = stats[bit].min_ns - (int32_t)sim_switch_time_ns(address);
+                    if (error < -5 || error > 5 || min_error < -5 || min_error > 5 || switching_stddev_ns(stats[bit]) != 0) {
+                        failures++;
+                    }
+                }
+            }
+            return failures;
+        }},
+        {"write_all_trimmed", 2, [] {
+            write_all(false);
+            write_all(true);
+            return 0;
+        }, setup_trims},
+        {"mem_test_gallop_trimmed", 1, [] {
+            return mem_test_gallop(0b00, 0b01);
+        }, setup_trims},
+        {"write_all_critical_measured", 2, [] {
+            waveform_mode = WAVEFORM_CRITICAL | WAVEFORM_MEASURE;
+            waveform_jitter_clear();
+            write_all(false);
+            write_all(true);
+            waveform_mode = WAVEFORM_NORMAL;
+
+            // Nothing interrupts the simulation, every phase has to take exactly its delay
+            int failures = 0;
+            for (int phase = 0; phase < PHASE_COUNT; phase++) {
+                failures += waveform_jitter[phase].samples != 1024 || waveform_jitter[phase].histogram[0] != 1024;
+            }
+            return failures;
+        }},
+        {"write_all_300mhz", 2, [] {
+            write_all(false);
+            write_all(true);
+            return 0;
+        }, nullptr, 300000},
+    };
+}
+
+static BenchResult run_case(const BenchCase &bench) {
+    set_sys_clock_khz(bench.sys_clock_khz, true);
+    sim_reset();
+    coremem_init();
+    core_trim_clear();
+    if (bench.setup) {
+        bench.setup();
+    }
+    sim_reset_stats();
+
+    // The dumps print the plane, keep that out of the results
+    std::streambuf *cout_buf = std::cout.rdbuf(nullptr);
+    int failures = bench.run();
+    std::cout.rdbuf(cout_buf);
+
+    const SimStats &stats = sim_stats();
+
+    BenchResult result;
+    result.name = bench.name;
+    result.calls = bench.calls;
+    result.waveforms = stats.waveforms;
+    result.drive_ns = stats.time_ps / 1000;
+    result.ops_per_s = stats.time_ps ? bench.calls * 1e12 / stats.time_ps : 0.0;
+    result.failures = failures;
+    return result;
+}
+
+static void write_csv(std::ostream &out, const std::vector<BenchResult> &results) {
+    out << "name,calls,waveforms,drive_ns,ops_per_s,failures\n";
+    for (const BenchResult &result : results) {
+        out << result.name << ',' << result.calls << ',' << result.waveforms << ',' << result.drive_ns << ','
+            << result.ops_per_s << ',' << result.failures << '\n';
+    }
+}
+
+static bool read_csv(const std::string &path, std::vector<BenchResult> &results) {
+    std::ifstream in(path);
+    if (!in) {
+        return false;
+    }
+
+    std::string line;
+    std::getline(in, line); // header
+    while (std::getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+
+        std::istringstream fields(line);
+        std::string field;
+        BenchResult result;
+        std::getline(fields, result.name, ',');
+        std::getline(fields, field, ',');
+        result.calls = std::stoull(field);
+        std::getline(fields, field, ',');
+        result.waveforms = std::stoull(field);
+        std::getline(fields, field, ',');
+        result.drive_ns = std::stoull(field);
+        std::getline(fields, field, ',');
+        result.ops_per_s = std::stod(field);
+        std::getline(fields, field, ',');
+        result.failures = std::stoull(field);
+        results.push_back(result);
+    }
+    return true;
+}
+
+// Returns the number of regressions against the baseline
+static int compare_baseline(const std::vector<BenchResult> &results, const std::vector<BenchResult> &baseline) {
+    int regressions = 0;
+
+    for (const BenchResult &base : baseline) {
+        const BenchResult *result = nullptr;
+        for (const BenchResult &candidate : results) {
+            if (candidate.name == base.name) {
+                result = &candidate;
+            }
+        }
+
+        if (!result) {
+            std::cerr << "missing benchmark: " << base.name << "\n";
+            regressions++;
+            continue;
+        }
+
+        if (result->waveforms > base.waveforms) {
+            std::cerr << base.name << ": waveforms " << result->waveforms << " > baseline " << base.waveforms << "\n";
+            regressions++;
+        }
+        if (result->drive_ns > base.drive_ns) {
+            std::cerr << base.name << ": drive time " << result->drive_ns << " ns > baseline " << base.drive_ns << " ns\n";
+            regressions++;
+        }
+        if (result->failures > base.failures) {
+            std::cerr << base.name << ": failures " << result->failures << " > baseline " << base.failures << "\n";
+            regressions++;
+        }
+    }
+
+    return regressions;
+}
+
+int main(int argc, char **argv) {
+    std::string csv_path;
+    std::string baseline_path;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--csv" && i + 1 < argc) {
+            csv_path = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--csv <results.csv>] [--baseline <baseline.csv>]\n";
+            return 2;
+        }
+    }
+
+    std::vector<BenchResult> results;
+    for (const BenchCase &bench : bench_cases()) {
+        results.push_back(run_case(bench));
+
+        const BenchResult &result = results.back();
+        std::cerr << result.name << ": " << result.waveforms << " waveforms, " << result.drive_ns / 1000 << " us, "
+                  << result.ops_per_s << " ops/s, " << result.failures << " failures\n";
+    }
+
+    if (csv_path.empty()) {
+        write_csv(std::cout, results);
+    } else {
+        std::ofstream out(csv_path);
+        write_csv(out, results);
+    }
+
+    if (!baseline_path.empty()) {
+        std::vector<BenchResult> baseline;
+        if (!read_csv(baseline_path, baseline)) {
+            std::cerr << "cannot read baseline " << baseline_path << "\n";
+            return 1;
+        }
+
+        int regressions = compare_baseline(results, baseline);
+        if (regressions > 0) {
+            std::cerr << regressions << " benchmark regression(s) against " << baseline_path << "\n";
+            return 1;
+        }
+    }
+
+    return 0;
+}
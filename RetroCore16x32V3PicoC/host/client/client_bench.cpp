@@ -0,0 +1,155 @@
+// Throughput of the host path, through the client library and the loopback stand-in of the controller.
+//
+// Every scenario writes a pattern to the whole plane and reads it back, and fails if the data does
+// not match. Besides the host time it reports how often the client had to wait for the controller,
+// which on real USB costs about one round trip each, and the modelled drive time of the controller.
+//
+// usage: coremem_client_bench [round trip in us, default 1000]
+
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "coremem_client.h"
+#include "loopback_transport.h"
+#include "sim_plane.h"
+#include "waveform_program.h"
+
+struct Scenario {
+    std::string name;
+    size_t max_in_flight;
+    bool reverse_responses;
+    std::function<std::vector<uint8_t>(CoreMemClient &, const std::vector<uint8_t> &)> run;
+};
+
+static uint8_t pattern(int address) {
+    return (address * 7 + (address >> 3)) & 0b11;
+}
+
+// One request at a time, waiting for each response
+static std::vector<uint8_t> run_sequential(CoreMemClient &client, const std::vector<uint8_t> &values) {
+    for (int address = 0; address < 256; ++address) {
+        client.wait(client.write(address, values[address]));
+    }
+
+    std::vector<uint8_t> read_back(256);
+    for (int address = 0; address < 256; ++address) {
+        read_back[address] = client.wait(client.read(address)).data.at(0);
+    }
+    return read_back;
+}
+
+// Every request submitted up front, completions collected by callbacks
+static std::vector<uint8_t> run_pipelined(CoreMemClient &client, const std::vector<uint8_t> &values) {
+    for (int address = 0; address < 256; ++address) {
+        client.write(address, values[address], [](const Response &) {});
+    }
+
+    std::vector<uint8_t> read_back(256);
+    for (int address = 0; address < 256; ++address) {
+        client.read(address, [&read_back, address](const Response &response) {
+            read_back[address] = response.data.at(0);
+        });
+    }
+    client.drain();
+    return read_back;
+}
+
+// A waveform program sampling more than it asked room for, sharing the frames with the requests after it
+static std::vector<uint8_t> run_with_waveform(CoreMemClient &client, const std::vector<uint8_t> &values) {
+    const WaveformStep steps[] = {wave_loop(400), wave_step(wave_none(), 0, true), wave_end_loop(), wave_end()};
+    std::vector<uint8_t> program(sizeof(steps) / sizeof(steps[0]) * WAVEFORM_STEP_SIZE);
+    waveform_encode(steps, sizeof(steps) / sizeof(steps[0]), program.data(), program.size());
+
+    size_t samples = 0;
+    client.run_waveform(program, 64, [&samples](const Response &response) {
+        samples = response.data.size();
+    });
+    std::vector<uint8_t> read_back = run_pipelined(client, values);
+    if (samples != 64) {
+        throw std::runtime_error("waveform samples not capped");
+    }
+    return read_back;
+}
+
+// Callbacks for every request, and waiting for the last one as well
+static std::vector<uint8_t> run_wait_on_callback(CoreMemClient &client, const std::vector<uint8_t> &values) {
+    for (int address = 0; address < 256; ++address) {
+        client.write(address, values[address], [](const Response &) {});
+    }
+
+    std::vector<uint8_t> read_back(256);
+    uint16_t last = 0;
+    for (int address = 0; address < 256; ++address) {
+        last = client.read(address, [&read_back, address](const Response &response) {
+            read_back[address] = response.data.at(0);
+        });
+    }
+    if (client.wait(last).data.at(0) != read_back[255] || read_back[255] != values[255]) {
+        throw std::runtime_error("waited response differs from the callback");
+    }
+    client.drain();
+    return read_back;
+}
+
+static std::vector<uint8_t> run_block(CoreMemClient &client, const std::vector<uint8_t> &values) {
+    client.write_block(0, std::vector<uint8_t>(values.begin(), values.begin() + 128));
+    client.write_block(128, std::vector<uint8_t>(values.begin() + 128, values.end()));
+    uint16_t low = client.read_block(0, 128);
+    uint16_t high = client.read_block(128, 128);
+
+    std::vector<uint8_t> read_back = client.wait(low).data;
+    std::vector<uint8_t> rest = client.wait(high).data;
+    read_back.insert(read_back.end(), rest.begin(), rest.end());
+    client.drain();
+    return read_back;
+}
+
+int main(int argc, char **argv) {
+    double round_trip_us = argc > 1 ? std::atof(argv[1]) : 1000.0;
+
+    std::vector<uint8_t> values(256);
+    for (int address = 0; address < 256; ++address) {
+        values[address] = pattern(address);
+    }
+
+    std::vector<Scenario> scenarios = {
+        {"sequential", 1, false, run_sequential},
+        {"pipelined", 64, false, run_pipelined},
+        {"pipelined_out_of_order", 64, true, run_pipelined},
+        {"block", 64, false, run_block},
+        {"pipelined_waveform", 64, false, run_with_waveform},
+        {"pipelined_wait_on_callback", 64, false, run_wait_on_callback},
+    };
+
+    int failures = 0;
+    std::cout << "name,requests,frames_sent,waits,host_us,drive_us,estimated_us\n";
+
+    for (const Scenario &scenario : scenarios) {
+        LoopbackTransport transport(scenario.reverse_responses);
+        CoreMemClient client(transport, scenario.max_in_flight);
+        sim_reset_stats();
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<uint8_t> read_back = scenario.run(client, values);
+        auto host_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+        if (read_back != values) {
+            std::cerr << scenario.name << ": read back does not match\n";
+            failures++;
+        }
+
+        const ClientStats &stats = client.stats();
+        uint64_t drive_us = sim_stats().time_ps / 1000000;
+        double estimated_us = stats.waits * round_trip_us + drive_us;
+
+        std::cout << scenario.name << ',' << stats.requests << ',' << stats.frames_sent << ',' << stats.waits << ','
+                  << host_us << ',' << drive_us << ',' << estimated_us << '\n';
+    }
+
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,268 @@
+#include "coremem_client.h"
+
+#include <stdexcept>
+
+CoreMemClient::CoreMemClient(Transport &transport, size_t max_in_flight, size_t max_frame)
+    : transport_(transport),
+      max_in_flight_(max_in_flight ? max_in_flight : 1),
+      max_frame_(max_frame),
+      next_seq_(0),
+      batch_response_size_(0),
+      stats_() {
+    protocol_parser_reset(&parser_);
+}
+
+uint16_t CoreMemClient::ping(const std::vector<uint8_t> &data, ResponseCallback done) {
+    return submit(CMD_PING, data, data.size(), done);
+}
+
+uint16_t CoreMemClient::read(uint8_t address, ResponseCallback done) {
+    return submit(CMD_READ, {address}, 1, done);
+}
+
+uint16_t CoreMemClient::write(uint8_t address, uint8_t value, ResponseCallback done) {
+    return submit(CMD_WRITE, {address, value}, 0, done);
+}
+
+uint16_t CoreMemClient::read_block(uint8_t start, uint16_t count, ResponseCallback done) {
+    return submit(CMD_READ_BLOCK, {start, (uint8_t)count, (uint8_t)(count >> 8)}, count, done);
+}
+
+uint16_t CoreMemClient::write_block(uint8_t start, const std::vector<uint8_t> &values, ResponseCallback done) {
+    std::vector<uint8_t> data;
+    data.reserve(values.size() + 1);
+    data.push_back(start);
+    data.insert(data.end(), values.begin(), values.end());
+    return submit(CMD_WRITE_BLOCK, data, 0, done);
+}
+
+uint16_t CoreMemClient::write_all(bool value, ResponseCallback done) {
+    return submit(CMD_WRITE_ALL, {value}, 0, done);
+}
+
+uint16_t CoreMemClient::run_waveform(const std::vector<uint8_t> &program, uint16_t max_samples, ResponseCallback done) {
+    std::vector<uint8_t> data(2);
+    protocol_put_u16(data.data(), max_samples);
+    data.insert(data.end(), program.begin(), program.end());
+    return submit(CMD_RUN_WAVEFORM, data, max_samples, done);
+}
+
+uint16_t CoreMemClient::run_test(uint8_t test, uint8_t default_pattern, uint8_t bit_pattern, ResponseCallback done) {
+    if (test == TEST_GALLOP) {
+        return submit(CMD_RUN_TEST, {test, default_pattern, bit_pattern}, 4, done);
+    }
+    return submit(CMD_RUN_TEST, {test}, 4, done);
+}
+
+uint16_t CoreMemClient::campaign_add(uint8_t test, uint8_t priority, uint8_t first_address, uint8_t last_address, uint16_t passes,
+                                     uint8_t default_pattern, uint8_t bit_pattern, ResponseCallback done) {
+    std::vector<uint8_t> data = {test, priority, default_pattern, bit_pattern, first_address, last_address, 0, 0};
+    protocol_put_u16(data.data() + 6, passes);
+    return submit(CMD_CAMPAIGN_ADD, data, 1, done);
+}
+
+uint16_t CoreMemClient::campaign_clear(ResponseCallback done) {
+    return submit(CMD_CAMPAIGN_CLEAR, {}, 0, done);
+}
+
+uint16_t CoreMemClient::campaign_start(uint64_t budget_us, uint8_t flags, ResponseCallback done) {
+    std::vector<uint8_t> data(9);
+    protocol_put_u64(data.data(), budget_us);
+    data[8] = flags;
+    return submit(CMD_CAMPAIGN_START, data, 0, done);
+}
+
+uint16_t CoreMemClient::campaign_abort(ResponseCallback done) {
+    return submit(CMD_CAMPAIGN_ABORT, {}, 0, done);
+}
+
+uint16_t CoreMemClient::campaign_resume(uint64_t budget_us, ResponseCallback done) {
+    std::vector<uint8_t> data(8);
+    protocol_put_u64(data.data(), budget_us);
+    return submit(CMD_CAMPAIGN_RESUME, data, 0, done);
+}
+
+uint16_t CoreMemClient::campaign_status(ResponseCallback done) {
+    // State, flags, job count and run time, then 12 bytes for each of up to 16 jobs
+    return submit(CMD_CAMPAIGN_STATUS, {}, 11 + 16 * 12, done);
+}
+
+uint16_t CoreMemClient::submit(uint8_t opcode, const std::vector<uint8_t> &data, uint32_t response_size, ResponseCallback done) {
+    uint32_t request_size = PROTOCOL_REQUEST_HEADER + data.size();
+    response_size += PROTOCOL_RESPONSE_HEADER;
+
+    if (request_size > PROTOCOL_MAX_PAYLOAD || response_size > PROTOCOL_MAX_PAYLOAD) {
+        throw std::invalid_argument("request too large for a frame");
+    }
+
+    // Start a new batch when the request, or its response, would not fit in this one
+    size_t max_payload = max_frame_ - PROTOCOL_FRAME_OVERHEAD;
+    if (!batch_.empty() && (batch_.size() + request_size > max_payload ||
+                            batch_response_size_ + response_size > PROTOCOL_MAX_PAYLOAD)) {
+        flush();
+    }
+
+    while (pending_.size() >= max_in_flight_) {
+        flush();
+        block(60000);
+    }
+
+    uint16_t seq = next_seq_++;
+    while (pending_.count(seq) || completed_.count(seq)) {
+        seq = next_seq_++;
+    }
+
+    uint8_t header[PROTOCOL_REQUEST_HEADER];
+    protocol_put_u16(header, seq);
+    header[2] = opcode;
+    protocol_put_u16(header + 3, data.size());
+    batch_.insert(batch_.end(), header, header + PROTOCOL_REQUEST_HEADER);
+    batch_.insert(batch_.end(), data.begin(), data.end());
+    batch_response_size_ += response_size;
+
+    pending_[seq] = done;
+    stats_.requests++;
+
+    if (batch_.size() >= max_payload) {
+        flush();
+    }
+
+    return seq;
+}
+
+void CoreMemClient::flush() {
+    if (batch_.empty()) {
+        return;
+    }
+
+    std::vector<uint8_t> frame(batch_.size() + PROTOCOL_FRAME_OVERHEAD);
+    protocol_frame(batch_.data(), batch_.size(), frame.data());
+    transport_.send(frame.data(), frame.size());
+
+    stats_.frames_sent++;
+    stats_.bytes_sent += frame.size();
+
+    batch_.clear();
+    batch_response_size_ = 0;
+}
+
+bool CoreMemClient::poll(int timeout_ms) {
+    uint64_t responses = stats_.responses;
+
+    uint8_t buffer[512];
+    size_t length = transport_.receive(buffer, sizeof(buffer), timeout_ms);
+    while (length > 0) {
+        for (size_t i = 0; i < length; i++) {
+            if (protocol_parse(&parser_, buffer[i])) {
+                handle_frame(parser_.payload, parser_.length);
+            }
+        }
+        // Take whatever else is already there
+        length = transport_.receive(buffer, sizeof(buffer), 0);
+    }
+
+    return stats_.responses != responses;
+}
+
+void CoreMemClient::block(int timeout_ms) {
+    stats_.waits++;
+    if (!poll(timeout_ms)) {
+        throw std::runtime_error("timed out waiting for the controller");
+    }
+}
+
+Response CoreMemClient::wait(uint16_t seq, int timeout_ms) {
+    flush();
+
+    // A request with a callback still gets its response there, keep a copy for here as well
+    auto pending = pending_.find(seq);
+    if (pending != pending_.end() && pending->second) {
+        ResponseCallback done = pending->second;
+        pending->second = [this, done](const Response &response) {
+            done(response);
+            completed_[response.seq] = response;
+        };
+    }
+
+    while (!completed_.count(seq)) {
+        if (!pending_.count(seq)) {
+            throw std::invalid_argument("no such request");
+        }
+        block(timeout_ms);
+    }
+
+    Response response = completed_[seq];
+    completed_.erase(seq);
+    return response;
+}
+
+void CoreMemClient::drain(int timeout_ms) {
+    flush();
+
+    while (!pending_.empty()) {
+        block(timeout_ms);
+    }
+}
+
+void CoreMemClient::on_telemetry(TelemetryCallback handler) {
+    telemetry_ = handler;
+}
+
+size_t CoreMemClient::in_flight() const {
+    return pending_.size();
+}
+
+const ClientStats &CoreMemClient::stats() const {
+    return stats_;
+}
+
+void CoreMemClient::handle_frame(const uint8_t *payload, uint16_t length) {
+    stats_.frames_received++;
+
+    uint32_t offset = 0;
+    while (offset + PROTOCOL_RESPONSE_HEADER <= length) {
+        Response response;
+        response.seq = protocol_get_u16(payload + offset);
+        response.opcode = payload[offset + 2];
+        response.status = payload[offset + 3];
+        uint16_t data_length = protocol_get_u16(payload + offset + 4);
+        offset += PROTOCOL_RESPONSE_HEADER;
+        if (offset + data_length > length) {
+            break;
+        }
+        response.data.assign(payload + offset, payload + offset + data_length);
+        offset += data_length;
+
+        if (response.opcode == CMD_TELEMETRY) {
+            handle_telemetry(response.data);
+            continue;
+        }
+
+        auto pending = pending_.find(response.seq);
+        if (pending == pending_.end()) {
+            continue;
+        }
+
+        ResponseCallback done = pending->second;
+        pending_.erase(pending);
+        stats_.responses++;
+
+        if (done) {
+            done(response);
+        } else {
+            completed_[response.seq] = response;
+        }
+    }
+}
+
+void CoreMemClient::handle_telemetry(const std::vector<uint8_t> &data) {
+    for (size_t offset = 0; offset + TELEMETRY_EVENT_SIZE <= data.size(); offset += TELEMETRY_EVENT_SIZE) {
+        TelemetryEvent event;
+        telemetry_decode(&data[offset], &event);
+        stats_.telemetry_events++;
+
+        if (telemetry_) {
+            telemetry_(event);
+        }
+    }
+}
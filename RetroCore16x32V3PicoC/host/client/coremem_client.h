@@ -0,0 +1,105 @@
+#pragma once
+
+#include <functional>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include "protocol.h"
+#include "telemetry.h"
+#include "transport.h"
+
+struct Response {
+    uint16_t seq;
+    uint8_t opcode;
+    uint8_t status;
+    std::vector<uint8_t> data;
+};
+
+using ResponseCallback = std::function<void(const Response &)>;
+using TelemetryCallback = std::function<void(const TelemetryEvent &)>;
+
+struct ClientStats {
+    uint64_t requests;
+    uint64_t responses;
+    uint64_t frames_sent;
+    uint64_t frames_received;
+    uint64_t bytes_sent;
+    uint64_t waits;  // times the client had to block on the controller
+    uint64_t telemetry_events;
+};
+
+/* Pipelined client for the controller command protocol (see protocol.h).
+
+Requests are collected into a batch, which is sent as a single frame once it fills a USB packet
+(max_frame bytes), when flush is called, or when a result is waited for. Up to max_in_flight
+requests may be outstanding; submitting more blocks until enough of them have completed.
+
+Every request returns its sequence number. Its response is either passed to the callback given
+with the request, or kept until it is collected with wait. The controller answers the requests of
+a frame in order, possibly spread over more than one response frame. The client matches the
+responses by their sequence number and does not rely on that order, which the loopback transport
+checks by reversing it (see loopback_transport.h).*/
+class CoreMemClient {
+public:
+    explicit CoreMemClient(Transport &transport, size_t max_in_flight = 64, size_t max_frame = 64);
+
+    uint16_t ping(const std::vector<uint8_t> &data = {}, ResponseCallback done = nullptr);
+    uint16_t read(uint8_t address, ResponseCallback done = nullptr);
+    uint16_t write(uint8_t address, uint8_t value, ResponseCallback done = nullptr);
+    uint16_t read_block(uint8_t start, uint16_t count, ResponseCallback done = nullptr);
+    uint16_t write_block(uint8_t start, const std::vector<uint8_t> &values, ResponseCallback done = nullptr);
+    uint16_t write_all(bool value, ResponseCallback done = nullptr);
+    // Samples beyond max_samples are dropped, room for max_samples is kept in the response frame
+    uint16_t run_waveform(const std::vector<uint8_t> &program, uint16_t max_samples = 256, ResponseCallback done = nullptr);
+    uint16_t run_test(uint8_t test, uint8_t default_pattern = 0, uint8_t bit_pattern = 0, ResponseCallback done = nullptr);
+
+    // Test campaign (see campaign.h), the progress comes in as telemetry events
+    uint16_t campaign_add(uint8_t test, uint8_t priority, uint8_t first_address, uint8_t last_address, uint16_t passes,
+                          uint8_t default_pattern = 0, uint8_t bit_pattern = 0, ResponseCallback done = nullptr);
+    uint16_t campaign_clear(ResponseCallback done = nullptr);
+    uint16_t campaign_start(uint64_t budget_us, uint8_t flags = 0, ResponseCallback done = nullptr);
+    uint16_t campaign_abort(ResponseCallback done = nullptr);
+    uint16_t campaign_resume(uint64_t budget_us, ResponseCallback done = nullptr);
+    uint16_t campaign_status(ResponseCallback done = nullptr);
+
+    // Send the batch collected so far
+    void flush();
+
+    // Handle the responses received within timeout_ms, returns true if there were any
+    bool poll(int timeout_ms);
+
+    // Wait for the response of a request. A request submitted with a callback gets it passed there
+    // first. Throws on timeout, or if seq is not in flight and its response was already collected.
+    Response wait(uint16_t seq, int timeout_ms = 60000);
+
+    // Wait until every request has completed, throws on timeout
+    void drain(int timeout_ms = 60000);
+
+    // Called for every telemetry event the controller sends, they are dropped without a handler
+    void on_telemetry(TelemetryCallback handler);
+
+    size_t in_flight() const;
+    const ClientStats &stats() const;
+
+private:
+    uint16_t submit(uint8_t opcode, const std::vector<uint8_t> &data, uint32_t response_size, ResponseCallback done);
+    void block(int timeout_ms);
+    void handle_frame(const uint8_t *payload, uint16_t length);
+    void handle_telemetry(const std::vector<uint8_t> &data);
+
+    Transport &transport_;
+    size_t max_in_flight_;
+    size_t max_frame_;
+
+    uint16_t next_seq_;
+    std::vector<uint8_t> batch_;
+    uint32_t batch_response_size_;
+
+    std::unordered_map<uint16_t, ResponseCallback> pending_;
+    std::unordered_map<uint16_t, Response> completed_;
+
+    TelemetryCallback telemetry_;
+    FrameParser parser_;
+    ClientStats stats_;
+};
@@ -0,0 +1,71 @@
+#include "loopback_transport.h"
+
+#include <vector>
+#include "pico/stdlib.h"
+#include "command.h"
+#include "coremem.h"
+#include "telemetry.h"
+#include "sim_plane.h"
+
+LoopbackTransport::LoopbackTransport(bool reverse_responses) : reverse_responses_(reverse_responses) {
+    protocol_parser_reset(&parser_);
+
+    set_sys_clock_khz(200000, true);
+    sim_reset();
+    coremem_init();
+}
+
+void LoopbackTransport::send(const uint8_t *data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        if (protocol_parse(&parser_, data[i])) {
+            execute(parser_.payload, parser_.length);
+        }
+    }
+}
+
+size_t LoopbackTransport::receive(uint8_t *data, size_t max_length, int timeout_ms) {
+    (void)timeout_ms;
+
+    size_t length = 0;
+    while (length < max_length && !received_.empty()) {
+        data[length++] = received_.front();
+        received_.pop_front();
+    }
+    return length;
+}
+
+void LoopbackTransport::execute(const uint8_t *payload, uint16_t length) {
+    std::vector<uint8_t> response(PROTOCOL_MAX_PAYLOAD);
+    uint32_t consumed = 0;
+    uint32_t response_length;
+    while ((response_length = command_execute(payload, length, &consumed, response.data(), response.size())) != 0) {
+        // What core 1 of the controller would send in the meantime
+        uint32_t telemetry_length;
+        std::vector<uint8_t> telemetry(PROTOCOL_MAX_PAYLOAD);
+        while ((telemetry_length = telemetry_fill(telemetry.data(), telemetry.size())) > 0) {
+            reply(telemetry.data(), telemetry_length);
+        }
+
+        if (!reverse_responses_) {
+            reply(response.data(), response_length);
+            continue;
+        }
+
+        std::vector<uint32_t> offsets;
+        for (uint32_t offset = 0; offset < response_length;) {
+            offsets.push_back(offset);
+            offset += PROTOCOL_RESPONSE_HEADER + protocol_get_u16(&response[offset + 4]);
+        }
+
+        for (auto offset = offsets.rbegin(); offset != offsets.rend(); ++offset) {
+            uint16_t size = PROTOCOL_RESPONSE_HEADER + protocol_get_u16(&response[*offset + 4]);
+            reply(&response[*offset], size);
+        }
+    }
+}
+
+void LoopbackTransport::reply(const uint8_t *payload, uint16_t length) {
+    std::vector<uint8_t> frame(length + PROTOCOL_FRAME_OVERHEAD);
+    protocol_frame(payload, length, frame.data());
+    received_.insert(received_.end(), frame.begin(), frame.end());
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <deque>
+#include "protocol.h"
+#include "transport.h"
+
+// Stand-in for a controller: the requests are executed in-process by the firmware command
+// handler, against the simulated core plane. There is only one simulated plane, so only use one
+// loopback transport at a time.
+class LoopbackTransport : public Transport {
+public:
+    // With reverse_responses, every response comes back in its own frame, those of a response
+    // payload in reverse order, to exercise out-of-order completion in the client. The controller
+    // itself always answers in order.
+    explicit LoopbackTransport(bool reverse_responses = false);
+
+    void send(const uint8_t *data, size_t length) override;
+    size_t receive(uint8_t *data, size_t max_length, int timeout_ms) override;
+
+private:
+    void execute(const uint8_t *payload, uint16_t length);
+    void reply(const uint8_t *payload, uint16_t length);
+
+    bool reverse_responses_;
+    FrameParser parser_;
+    std::deque<uint8_t> received_;
+};
@@ -0,0 +1,57 @@
+#include "serial_transport.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdexcept>
+#include <termios.h>
+#include <unistd.h>
+
+SerialTransport::SerialTransport(const std::string &path) {
+    fd_ = open(path.c_str(), O_RDWR | O_NOCTTY);
+    if (fd_ < 0) {
+        throw std::runtime_error("cannot open " + path + ": " + strerror(errno));
+    }
+
+    // Raw bytes, the protocol is binary
+    termios tty;
+    if (tcgetattr(fd_, &tty) != 0) {
+        close(fd_);
+        throw std::runtime_error("cannot configure " + path + ": " + strerror(errno));
+    }
+    cfmakeraw(&tty);
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+    tcsetattr(fd_, TCSANOW, &tty);
+    tcflush(fd_, TCIOFLUSH);
+}
+
+SerialTransport::~SerialTransport() {
+    close(fd_);
+}
+
+void SerialTransport::send(const uint8_t *data, size_t length) {
+    while (length > 0) {
+        ssize_t written = write(fd_, data, length);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("serial write failed: ") + strerror(errno));
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+size_t SerialTransport::receive(uint8_t *data, size_t max_length, int timeout_ms) {
+    pollfd fd = {fd_, POLLIN, 0};
+    int ready = ::poll(&fd, 1, timeout_ms);
+    if (ready <= 0) {
+        return 0;
+    }
+
+    ssize_t received = read(fd_, data, max_length);
+    return received > 0 ? received : 0;
+}
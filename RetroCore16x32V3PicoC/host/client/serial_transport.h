@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include "transport.h"
+
+// The USB serial port of a controller on Linux, such as /dev/ttyACM0
+class SerialTransport : public Transport {
+public:
+    explicit SerialTransport(const std::string &path);
+    ~SerialTransport() override;
+
+    SerialTransport(const SerialTransport &) = delete;
+    SerialTransport &operator=(const SerialTransport &) = delete;
+
+    void send(const uint8_t *data, size_t length) override;
+    size_t receive(uint8_t *data, size_t max_length, int timeout_ms) override;
+
+private:
+    int fd_;
+};
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte stream to a controller, such as its USB serial port
+class Transport {
+public:
+    virtual ~Transport() = default;
+
+    virtual void send(const uint8_t *data, size_t length) = 0;
+
+    // Returns the number of bytes received, waiting at most timeout_ms for the first one
+    virtual size_t receive(uint8_t *data, size_t max_length, int timeout_ms) = 0;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in for the SysTick registers. The current value counts down with the cycles
+// spent in the simulated busy waits, wrapping at 24 bits like the real counter.
+
+struct SimSysTickValue {
+    operator uint32_t() const;
+    SimSysTickValue &operator=(uint32_t value);
+};
+
+typedef struct {
+    uint32_t csr;
+    uint32_t rvr;
+    SimSysTickValue cvr;
+    uint32_t calib;
+} systick_hw_t;
+
+extern systick_hw_t *const systick_hw;
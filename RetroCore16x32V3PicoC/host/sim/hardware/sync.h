@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in for hardware/sync.h, there are no interrupts in the simulation
+
+static inline uint32_t save_and_disable_interrupts() {
+    return 0;
+}
+
+static inline void restore_interrupts(uint32_t status) {
+    (void)status;
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <stdint.h>
+
+// Host stand-in for pico/flash.h, there is no other core or XIP cache to get out of the way
+
+#define PICO_OK 0
+
+// Runs func straight away, returns PICO_OK
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t enter_exit_timeout_ms);
+
+bool flash_safe_execute_core_init();
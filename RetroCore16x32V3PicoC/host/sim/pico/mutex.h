@@ -0,0 +1,21 @@
+#pragma once
+
+// Host stand-in for pico/mutex.h, the simulation runs on a single thread
+
+typedef struct {
+    int owner;
+} mutex_t;
+
+#define auto_init_mutex(name) static mutex_t name = {0}
+
+static inline void mutex_init(mutex_t *mtx) {
+    mtx->owner = 0;
+}
+
+static inline void mutex_enter_blocking(mutex_t *mtx) {
+    mtx->owner = 1;
+}
+
+static inline void mutex_exit(mutex_t *mtx) {
+    mtx->owner = 0;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+// Host stand-in for the subset of the Pico SDK used by the controller firmware.
+// Every call is routed into the simulated core plane (see sim_plane.h), so the
+// firmware sources can be compiled and run unmodified on Linux.
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+// Everything runs from the same memory on the host
+#define __not_in_flash_func(func_name) func_name
+
+#define PICO_ERROR_TIMEOUT -1
+
+#define GPIO_OUT true
+#define GPIO_IN false
+
+void gpio_init(uint gpio);
+void gpio_set_dir(uint gpio, bool out);
+void gpio_put(uint gpio, bool value);
+void gpio_put_masked(uint32_t mask, uint32_t value);
+bool gpio_get(uint gpio);
+uint32_t gpio_get_all();
+
+void busy_wait_at_least_cycles(uint32_t minimum_cycles);
+void busy_wait_us(uint64_t delay_us);
+void busy_wait_us_32(uint32_t delay_us);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+uint64_t time_us_64();
+uint32_t time_us_32();
+
+bool set_sys_clock_khz(uint32_t freq_khz, bool required);
+bool stdio_init_all();
+void stdio_flush();
+int getchar_timeout_us(uint32_t timeout_us);
+int putchar_raw(int c);
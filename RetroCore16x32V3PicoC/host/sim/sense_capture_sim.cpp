@@ -0,0 +1,21 @@
+// Host stand-in for the PIO sense capture, the edges come from the switching times of the plane model
+
+#include "coremem.h"
+#include "sense_capture.h"
+#include "sim_plane.h"
+
+void sense_capture_init() {
+}
+
+void sense_capture_arm() {
+}
+
+void sense_capture_finish(int32_t edge_cycles[2]) {
+    for (int bit = 0; bit < 2; bit++) {
+        uint32_t ns;
+        edge_cycles[bit] = -1;
+        if (sim_sense_edge_ns(bit, &ns) && ns_to_cycles(ns) < SENSE_CAPTURE_WORDS * 16) {
+            edge_cycles[bit] = ns_to_cycles(ns);
+        }
+    }
+}
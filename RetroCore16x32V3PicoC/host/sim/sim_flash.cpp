@@ -0,0 +1,96 @@
+#include "sim_flash.h"
+
+#include <string.h>
+#include "pico/flash.h"
+#include "hardware/flash.h"
+
+uint8_t sim_flash[PICO_FLASH_SIZE_BYTES];
+
+namespace {
+
+struct SimFlash {
+    SimFlashStats stats;
+    bool cut_pending;
+    uint32_t cut_bytes; // left until the power is cut
+    bool powered_off;
+};
+
+SimFlash flash;
+
+struct SimFlashInit {
+    SimFlashInit() {
+        sim_flash_reset();
+    }
+} sim_flash_init;
+
+// Bytes of an operation which happen before the power goes, all of them if it stays on
+size_t bytes_before_cut(size_t count) {
+    if (flash.powered_off) {
+        return 0;
+    }
+    if (!flash.cut_pending) {
+        return count;
+    }
+
+    flash.cut_pending = false;
+    flash.powered_off = true;
+    return flash.cut_bytes < count ? flash.cut_bytes : count;
+}
+
+} // namespace
+
+void sim_flash_reset() {
+    memset(sim_flash, 0xFF, sizeof(sim_flash));
+    flash = SimFlash{};
+}
+
+const SimFlashStats &sim_flash_stats() {
+    return flash.stats;
+}
+
+uint8_t *sim_flash_data(uint32_t offset) {
+    return sim_flash + offset;
+}
+
+void sim_flash_cut_power_after(uint32_t bytes) {
+    flash.cut_pending = true;
+    flash.cut_bytes = bytes;
+}
+
+void sim_flash_power_on() {
+    flash.cut_pending = false;
+    flash.powered_off = false;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count) {
+    // Only whole sectors can be erased
+    if (flash_offs % FLASH_SECTOR_SIZE || count % FLASH_SECTOR_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES) {
+        return;
+    }
+
+    memset(sim_flash + flash_offs, 0xFF, bytes_before_cut(count));
+    flash.stats.erases += count / FLASH_SECTOR_SIZE;
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t *data, size_t count) {
+    // Only whole pages can be programmed
+    if (flash_offs % FLASH_PAGE_SIZE || count % FLASH_PAGE_SIZE || flash_offs + count > PICO_FLASH_SIZE_BYTES) {
+        return;
+    }
+
+    size_t programmed = bytes_before_cut(count);
+    for (size_t i = 0; i < programmed; i++) {
+        sim_flash[flash_offs + i] &= data[i];
+    }
+    flash.stats.programs += count / FLASH_PAGE_SIZE;
+}
+
+int flash_safe_execute(void (*func)(void *), void *param, uint32_t enter_exit_timeout_ms) {
+    (void)enter_exit_timeout_ms;
+    func(param);
+    return PICO_OK;
+}
+
+bool flash_safe_execute_core_init() {
+    return true;
+}
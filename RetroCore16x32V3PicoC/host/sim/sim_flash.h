@@ -0,0 +1,25 @@
+#pragma once
+
+#include <stdint.h>
+
+// Behavioural model of the NOR flash behind XIP_BASE. Erasing sets whole sectors to 0xFF,
+// programming can only clear bits, like the real part. The contents outlive sim_reset, as
+// they would a reset of the board.
+
+struct SimFlashStats {
+    uint32_t erases;   // sectors
+    uint32_t programs; // pages
+};
+
+// Erase the whole flash, as on a new board, and clear the statistics
+void sim_flash_reset();
+const SimFlashStats &sim_flash_stats();
+
+// Direct access to the contents, bypassing the erase and program rules
+uint8_t *sim_flash_data(uint32_t offset);
+
+// Cut the power after the next erase or program operation has changed bytes bytes. Every
+// operation after that is ignored until sim_flash_power_on, like the board losing power part
+// way through.
+void sim_flash_cut_power_after(uint32_t bytes);
+void sim_flash_power_on();
@@ -0,0 +1,381 @@
+#include "sim_plane.h"
+
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "coremem.h"
+
+namespace {
+
+struct DrivenCore {
+    uint8_t address;
+    int8_t total[2]; // sum of the half currents per bit plane, +2/-2 is a full current
+};
+
+struct SimPlane {
+    uint32_t pins;
+    uint8_t cores[256];
+    uint32_t switch_time_ns[256];
+    uint32_t recovery_time_ns[256];
+    bool latch[2];
+    uint32_t sys_clock_hz;
+    uint64_t now_ps;
+    uint64_t now_cycles;
+    uint32_t systick_start; // SysTick value at now_cycles == systick_offset
+    uint64_t systick_offset;
+
+    bool y_on;
+    uint64_t y_on_time_ps;
+    // End of the last Y pulse and its address, a pulse starting before its lines recovered does nothing
+    bool y_pulsed;
+    uint64_t y_off_time_ps;
+    uint8_t y_off_address;
+    bool recovering;
+    // Time from the Y drive turning on to the first switch seen by each sense latch, during the last pulse
+    uint32_t sense_edge_ns[2];
+    // Sense reads since the Y drive last turned on, and the samples which read inverted
+    uint32_t sense_reads;
+    uint8_t flip_address;
+    uint32_t sense_flips[2];
+    // Cores on the selected lines while the Y drive is on
+    DrivenCore driven[31];
+    int driven_count;
+
+    SimStats stats;
+};
+
+SimPlane plane;
+
+// Fast cores near the drivers, slower ones at the far end of the X and Y lines
+uint32_t default_switch_time_ns(uint8_t address) {
+    uint8_t xAddress = address & 0xF;
+    uint8_t yAddress = (address >> 4) & 0xF;
+    uint32_t ns = 450 + xAddress * 12 + yAddress * 18;
+    if ((xAddress + yAddress) % 2 != 0) {
+        ns += 40;
+    }
+    return ns;
+}
+
+// The lines ring for longer the further they reach
+uint32_t default_recovery_time_ns(uint8_t address) {
+    uint8_t xAddress = address & 0xF;
+    uint8_t yAddress = (address >> 4) & 0xF;
+    return 950 + xAddress * 10 + yAddress * 15;
+}
+
+MosfetBridgeState bridge_state(uint32_t pins, uint en_pin) {
+    return static_cast<MosfetBridgeState>((pins >> en_pin) & 0b11);
+}
+
+bool conducting(MosfetBridgeState state) {
+    return state == MosfetBridgeState::CONDUCT_DIR_1 || state == MosfetBridgeState::CONDUCT_DIR_2;
+}
+
+// Direction of the X current through a core, +1 is the direction which writes a 1
+int x_current(MosfetBridgeState state, uint8_t xAddress, uint8_t yAddress) {
+    bool invertX = ((xAddress + yAddress) % 2 != 0);
+    return ((state == MosfetBridgeState::CONDUCT_DIR_2) != invertX) ? 1 : -1;
+}
+
+int y_current(MosfetBridgeState state) {
+    return state == MosfetBridgeState::CONDUCT_DIR_1 ? 1 : -1;
+}
+
+int inhibit_current(MosfetBridgeState state, uint8_t yAddress) {
+    return ((state == MosfetBridgeState::CONDUCT_DIR_2) != (yAddress % 2 == 0)) ? -1 : 1;
+}
+
+void y_drive_on() {
+    uint8_t selected = (plane.pins >> ADDR_X0_PIN) & 0xFF;
+    uint8_t selectedX = selected & 0xF;
+    uint8_t selectedY = (selected >> 4) & 0xF;
+
+    MosfetBridgeState x = bridge_state(plane.pins, X_EN_PIN);
+    MosfetBridgeState y = bridge_state(plane.pins, Y_EN_PIN);
+    MosfetBridgeState ihb[2] = {bridge_state(plane.pins, IHB0_EN_PIN), bridge_state(plane.pins, IHB1_EN_PIN)};
+
+    // Only cores on the selected X or Y line can see more than a half current
+    plane.driven_count = 0;
+    for (int address = 0; address < 256; ++address) {
+        uint8_t xAddress = address & 0xF;
+        uint8_t yAddress = (address >> 4) & 0xF;
+        bool on_x = xAddress == selectedX && conducting(x);
+        bool on_y = yAddress == selectedY;
+        if (!on_x && !on_y) {
+            continue;
+        }
+
+        int sum = 0;
+        if (on_x) {
+            sum += x_current(x, xAddress, yAddress);
+        }
+        if (on_y) {
+            sum += y_current(y);
+        }
+
+        DrivenCore &core = plane.driven[plane.driven_count++];
+        core.address = address;
+        for (int bit = 0; bit < 2; ++bit) {
+            int total = sum;
+            if (conducting(ihb[bit])) {
+                total += inhibit_current(ihb[bit], yAddress);
+            }
+            core.total[bit] = total;
+        }
+    }
+
+    plane.recovering = plane.y_pulsed &&
+        plane.now_ps - plane.y_off_time_ps < uint64_t(plane.recovery_time_ns[plane.y_off_address]) * 1000;
+    plane.y_on = true;
+    plane.y_on_time_ps = plane.now_ps;
+    plane.y_off_address = selected;
+    plane.sense_edge_ns[0] = UINT32_MAX;
+    plane.sense_edge_ns[1] = UINT32_MAX;
+    plane.sense_reads = 0;
+    plane.stats.waveforms++;
+}
+
+void y_drive_off() {
+    uint64_t width_ps = plane.now_ps - plane.y_on_time_ps;
+    bool latch_enabled = (plane.pins >> SENSE_RST_PIN) & 1;
+
+    for (int i = 0; i < plane.driven_count && !plane.recovering; ++i) {
+        const DrivenCore &core = plane.driven[i];
+        if (width_ps < uint64_t(plane.switch_time_ns[core.address]) * 1000) {
+            continue;
+        }
+
+        for (int bit = 0; bit < 2; ++bit) {
+            int total = core.total[bit];
+            if (total >= 2 || total <= -2) {
+                uint8_t target = total > 0 ? 1 : 0;
+                uint8_t current = (plane.cores[core.address] >> bit) & 1;
+                if (current != target) {
+                    plane.cores[core.address] ^= (1 << bit);
+                    plane.stats.flips++;
+                    if (latch_enabled) {
+                        plane.latch[bit] = true;
+                        if (plane.switch_time_ns[core.address] < plane.sense_edge_ns[bit]) {
+                            plane.sense_edge_ns[bit] = plane.switch_time_ns[core.address];
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    plane.y_on = false;
+    plane.y_pulsed = true;
+    plane.y_off_time_ps = plane.now_ps;
+}
+
+void update_pins(uint32_t pins) {
+    plane.pins = pins;
+
+    if (!((plane.pins >> SENSE_RST_PIN) & 1)) {
+        plane.latch[0] = false;
+        plane.latch[1] = false;
+    }
+
+    bool y_on = conducting(bridge_state(plane.pins, Y_EN_PIN));
+    if (y_on && !plane.y_on) {
+        y_drive_on();
+    } else if (!y_on && plane.y_on) {
+        y_drive_off();
+    }
+}
+
+void advance_cycles(uint64_t cycles) {
+    uint64_t ps = cycles * 1000000000000ull / plane.sys_clock_hz;
+    plane.stats.cycles += cycles;
+    plane.now_cycles += cycles;
+    plane.stats.time_ps += ps;
+    plane.now_ps += ps;
+}
+
+void advance_us(uint64_t us) {
+    plane.stats.cycles += us * plane.sys_clock_hz / 1000000;
+    plane.now_cycles += us * plane.sys_clock_hz / 1000000;
+    plane.stats.time_ps += us * 1000000;
+    plane.now_ps += us * 1000000;
+}
+
+struct SimInit {
+    SimInit() {
+        plane.sys_clock_hz = 125000000;
+        sim_reset();
+    }
+} sim_init;
+
+} // namespace
+
+void sim_reset() {
+    plane.pins = 0;
+    plane.latch[0] = false;
+    plane.latch[1] = false;
+    plane.y_on = false;
+    plane.y_on_time_ps = plane.now_ps;
+    plane.y_pulsed = false;
+    plane.sense_edge_ns[0] = UINT32_MAX;
+    plane.sense_edge_ns[1] = UINT32_MAX;
+    plane.sense_reads = 0;
+    plane.sense_flips[0] = 0;
+    plane.sense_flips[1] = 0;
+    for (int address = 0; address < 256; ++address) {
+        plane.cores[address] = 0;
+        plane.switch_time_ns[address] = default_switch_time_ns(address);
+        plane.recovery_time_ns[address] = default_recovery_time_ns(address);
+    }
+    sim_reset_stats();
+}
+
+void sim_reset_stats() {
+    plane.stats = SimStats{};
+}
+
+const SimStats &sim_stats() {
+    return plane.stats;
+}
+
+uint32_t sim_sys_clock_hz() {
+    return plane.sys_clock_hz;
+}
+
+uint8_t sim_peek(uint8_t address) {
+    return plane.cores[address];
+}
+
+void sim_poke(uint8_t address, uint8_t value) {
+    plane.cores[address] = value & 0b11;
+}
+
+uint32_t sim_switch_time_ns(uint8_t address) {
+    return plane.switch_time_ns[address];
+}
+
+void sim_set_switch_time_ns(uint8_t address, uint32_t ns) {
+    plane.switch_time_ns[address] = ns;
+}
+
+uint32_t sim_recovery_time_ns(uint8_t address) {
+    return plane.recovery_time_ns[address];
+}
+
+void sim_set_recovery_time_ns(uint8_t address, uint32_t ns) {
+    plane.recovery_time_ns[address] = ns;
+}
+
+void sim_set_sense_flips(uint8_t address, uint32_t flips0, uint32_t flips1) {
+    plane.flip_address = address;
+    plane.sense_flips[0] = flips0;
+    plane.sense_flips[1] = flips1;
+}
+
+bool sim_sense_edge_ns(int bit, uint32_t *ns) {
+    *ns = plane.sense_edge_ns[bit];
+    return *ns != UINT32_MAX;
+}
+
+static systick_hw_t sim_systick;
+systick_hw_t *const systick_hw = &sim_systick;
+
+SimSysTickValue::operator uint32_t() const {
+    return (plane.systick_start - (plane.now_cycles - plane.systick_offset)) & 0xFFFFFF;
+}
+
+SimSysTickValue &SimSysTickValue::operator=(uint32_t value) {
+    plane.systick_start = value & 0xFFFFFF;
+    plane.systick_offset = plane.now_cycles;
+    return *this;
+}
+
+void gpio_init(uint gpio) {
+    update_pins(plane.pins & ~(1u << gpio));
+}
+
+void gpio_set_dir(uint gpio, bool out) {
+    (void)gpio;
+    (void)out;
+}
+
+void gpio_put(uint gpio, bool value) {
+    gpio_put_masked(1u << gpio, uint32_t(value) << gpio);
+}
+
+void gpio_put_masked(uint32_t mask, uint32_t value) {
+    update_pins((plane.pins & ~mask) | (value & mask));
+}
+
+uint32_t gpio_get_all() {
+    bool latch[2] = {plane.latch[0], plane.latch[1]};
+    if (plane.y_pulsed && plane.y_off_address == plane.flip_address && plane.sense_reads < 32) {
+        latch[0] ^= (plane.sense_flips[0] >> plane.sense_reads) & 1;
+        latch[1] ^= (plane.sense_flips[1] >> plane.sense_reads) & 1;
+    }
+    plane.sense_reads++;
+
+    uint32_t sense = (uint32_t(latch[0]) << SENSE0_DATA_PIN) | (uint32_t(latch[1]) << SENSE1_DATA_PIN);
+    uint32_t sense_mask = (1u << SENSE0_DATA_PIN) | (1u << SENSE1_DATA_PIN);
+    return (plane.pins & ~sense_mask) | sense;
+}
+
+bool gpio_get(uint gpio) {
+    return (gpio_get_all() >> gpio) & 1;
+}
+
+void busy_wait_at_least_cycles(uint32_t minimum_cycles) {
+    advance_cycles(minimum_cycles);
+}
+
+void busy_wait_us(uint64_t delay_us) {
+    advance_us(delay_us);
+}
+
+void busy_wait_us_32(uint32_t delay_us) {
+    advance_us(delay_us);
+}
+
+void sleep_us(uint64_t us) {
+    advance_us(us);
+}
+
+void sleep_ms(uint32_t ms) {
+    advance_us(uint64_t(ms) * 1000);
+}
+
+uint64_t time_us_64() {
+    return plane.now_ps / 1000000;
+}
+
+uint32_t time_us_32() {
+    return uint32_t(time_us_64());
+}
+
+bool set_sys_clock_khz(uint32_t freq_khz, bool required) {
+    (void)required;
+    plane.sys_clock_hz = freq_khz * 1000;
+    return true;
+}
+
+bool stdio_init_all() {
+    return true;
+}
+
+// There is no USB serial port in the simulation, commands are executed directly (see the loopback transport)
+void stdio_flush() {
+}
+
+int getchar_timeout_us(uint32_t timeout_us) {
+    (void)timeout_us;
+    return PICO_ERROR_TIMEOUT;
+}
+
+int putchar_raw(int c) {
+    return c;
+}
+
+uint32_t clock_get_hz(enum clock_index clk_index) {
+    (void)clk_index;
+    return plane.sys_clock_hz;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <stdint.h>
+
+// Behavioural model of the 16x16x2 core plane sitting behind the controller pins.
+//
+// Each core sees the sum of the half currents of the lines threaded through it (X, Y and the
+// inhibit line of its bit plane), with the winding orientation following the same X+Y parity
+// rule the firmware uses. A core only switches when it sees a full current for at least its
+// switching time, and only if the lines of the previous pulse had their recovery time to settle
+// before the Y drive turned on again. A switch sets the sense latch of its bit plane while the
+// latch is not held in reset.
+//
+// Time only advances through the busy waits, so the totals below are the modelled drive time
+// of the delay budgets in the firmware, independent of how fast the host runs.
+
+struct SimStats {
+    uint64_t waveforms;  // number of Y drive pulses
+    uint64_t cycles;     // system clock cycles spent in busy waits
+    uint64_t time_ps;    // modelled time spent in busy waits
+    uint64_t flips;      // number of cores that changed state
+};
+
+// Clear the plane, the pins and the statistics
+void sim_reset();
+void sim_reset_stats();
+const SimStats &sim_stats();
+
+uint32_t sim_sys_clock_hz();
+
+// Direct access to the modelled cores, bypassing the drive circuitry
+uint8_t sim_peek(uint8_t address);
+void sim_poke(uint8_t address, uint8_t value);
+
+// Minimum full current pulse width needed to switch the cores at an address
+uint32_t sim_switch_time_ns(uint8_t address);
+void sim_set_switch_time_ns(uint8_t address, uint32_t ns);
+
+// Minimum time from the end of a Y pulse at an address to the start of the next one
+uint32_t sim_recovery_time_ns(uint8_t address);
+void sim_set_recovery_time_ns(uint8_t address, uint32_t ns);
+
+// Make the sense latches of an address disagree between samples: after a Y pulse at the address,
+// read n of the sense pins sees bit b inverted when bit n of flips[b] is set. Cleared by sim_reset.
+void sim_set_sense_flips(uint8_t address, uint32_t flips0, uint32_t flips1);
+
+// Time from the Y drive turning on to the first switch which set the sense latch of a bit,
+// during the last Y pulse. Returns false if the latch was not set.
+bool sim_sense_edge_ns(int bit, uint32_t *ns);
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <bitset>
+#include <iostream>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/vreg.h"
+#include "coremem.h"
+#include "calibration.h"
+#include "command.h"
+#include "telemetry.h"
+#include "switching_stats.h"
+#include "campaign.h"
+#include "pico/multicore.h"
+#include "pico/flash.h"
+
+#ifdef COREMEM_SYS_CLOCK_KHZ
+#define SYS_CLOCK_KHZ COREMEM_SYS_CLOCK_KHZ
+#else
+#define SYS_CLOCK_KHZ 200000
+#endif
+
+// While a host is sending commands a yielding campaign is paused, until the host has been quiet for this long
+#define HOST_IDLE_US 5000000
+// Longest wait for the host while paused, so the pause ends soon after HOST_IDLE_US
+#define HOST_POLL_US 10000
+
+// Core 1 only sends the telemetry, so the tests on core 0 never wait for USB
+void telemetry_core1_main() {
+    // Let flash_safe_execute on core 0 park this core while the calibration is written
+    flash_safe_execute_core_init();
+    multicore_fifo_push_blocking(1);
+
+    while (true) {
+        if (!telemetry_drain()) {
+            sleep_ms(1);
+        }
+    }
+}
+
+// Returns true while a host is using the command protocol
+bool host_active() {
+    uint64_t last = command_last_activity_us();
+    return last != 0 && time_us_64() - last < HOST_IDLE_US;
+}
+
+int main()
+{      
+#if SYS_CLOCK_KHZ > 250000
+    // Overclocking needs a higher core voltage
+    vreg_set_voltage(VREG_VOLTAGE_1_20);
+    sleep_ms(10);
+#endif
+
+    // Set cpu clock, 200MHz unless the build asks for another one
+    set_sys_clock_khz(SYS_CLOCK_KHZ, true);
+
+    stdio_init_all();
+    multicore_launch_core1(telemetry_core1_main);
+    multicore_fifo_pop_blocking();
+
+    coremem_init();
+
+    // Keep the USB interrupts out of the waveforms, and keep track of how well that works
+    waveform_mode = WAVEFORM_CRITICAL | WAVEFORM_MEASURE;
+
+    // Come up with the tuned timing of this board, before the first memory access
+    if (calibration_load()) {
+        calibration_apply();
+        telemetry_emit(EVENT_CALIBRATION, CALIBRATION_LOADED, 0, 0, 0);
+    } else {
+        // First start-up of this board, characterise it once and keep the result
+        int bad = characterise_trims(5, calibration.bad_cores);
+        calibration_capture();
+        if (!calibration_save()) {
+            telemetry_emit(EVENT_CALIBRATION, CALIBRATION_SAVE_FAILED, 0, bad, 0);
+        }
+        telemetry_emit(EVENT_CALIBRATION, CALIBRATION_CHARACTERISED, 0, bad, 0);
+
+        // Log how much of the saturation time the cores actually need
+        characterise_switching(4);
+    }
+
+    
+    //std::bitset<8> x1(*val1);
+    //std::cout << x1 << '\n';
+
+    // Without a host the tests of old run forever, a host can replace them with its own campaign
+    campaign_load_default();
+    campaign_start(0, CAMPAIGN_REPEAT | CAMPAIGN_YIELD);
+
+    while (true) {
+        if ((campaign_flags() & CAMPAIGN_YIELD) && host_active()) {
+            // Only serve the host, sleeping until it sends something
+            command_poll(HOST_POLL_US);
+            continue;
+        }
+
+        command_poll();
+        if (!campaign_step()) {
+            // Nothing to run until the host starts a campaign
+            sleep_ms(1);
+        }
+    }
+}
@@ -0,0 +1,89 @@
+#include <string.h>
+#include "coremem.h"
+#include "plane_snapshot.h"
+
+PlaneSnapshot *tracked_snapshot = nullptr;
+
+static void start_tracking(PlaneSnapshot *snapshot) {
+    memcpy(snapshot->current, snapshot->image, sizeof(snapshot->image));
+    memset(snapshot->dirty, 0, sizeof(snapshot->dirty));
+    tracked_snapshot = snapshot;
+}
+
+void snapshot_capture(PlaneSnapshot *snapshot) {
+    tracked_snapshot = nullptr;
+
+    for (int address = 0; address < 256; ++address) {
+        snapshot_put(snapshot->image, address, read_memory(address));
+    }
+
+    start_tracking(snapshot);
+}
+
+void snapshot_assume(PlaneSnapshot *snapshot, uint8_t value) {
+    value &= 0b11;
+    memset(snapshot->image, value | (value << 2) | (value << 4) | (value << 6), sizeof(snapshot->image));
+
+    start_tracking(snapshot);
+}
+
+int snapshot_restore() {
+    PlaneSnapshot *snapshot = tracked_snapshot;
+    if (!snapshot) {
+        return 0;
+    }
+
+    int pulses = 0;
+
+    for (int i = 0; i < 32; ++i) {
+        // write_memory_waveform clears the bits as the addresses are restored
+        while (snapshot->dirty[i]) {
+            uint8_t address = i * 8 + __builtin_ctz(snapshot->dirty[i]);
+            uint8_t current = snapshot_get(snapshot->current, address);
+            uint8_t target = snapshot_get(snapshot->image, address);
+
+            if (current & ~target) {
+                write_memory_waveform(address, false, current & ~target, false);
+                pulses++;
+            }
+            if (target & ~current) {
+                write_memory_waveform(address, true, target & ~current, false);
+                pulses++;
+            }
+        }
+    }
+
+    return pulses;
+}
+
+void snapshot_release() {
+    tracked_snapshot = nullptr;
+}
+
+int snapshot_dirty_count() {
+    if (!tracked_snapshot) {
+        return 0;
+    }
+
+    int count = 0;
+    for (int i = 0; i < 32; ++i) {
+        count += __builtin_popcount(tracked_snapshot->dirty[i]);
+    }
+    return count;
+}
+
+void snapshot_track(uint8_t address, bool dir, uint8_t enable_mask) {
+    PlaneSnapshot *snapshot = tracked_snapshot;
+
+    // A pulse in the set direction sets the enabled bits, the inhibited ones keep their value
+    uint8_t value = snapshot_get(snapshot->current, address);
+    value = dir ? (value | enable_mask) : (value & ~enable_mask);
+    snapshot_put(snapshot->current, address, value);
+
+    uint8_t bit = 1 << (address & 7);
+    if (value != snapshot_get(snapshot->image, address)) {
+        snapshot->dirty[address >> 3] |= bit;
+    } else {
+        snapshot->dirty[address >> 3] &= ~bit;
+    }
+}
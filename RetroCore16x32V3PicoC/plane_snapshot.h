@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Snapshot of the whole plane, for putting a background back after a test has changed a few addresses.
+
+The images are packed like the calibration bad core mask, 2 bits per address: address a is in
+byte a >> 2 at bit (a & 3) * 2.
+
+While a snapshot is tracked, write_memory_waveform records what every pulse leaves in the cores
+it drives, including the restore half of read_memory, so a core which read back wrong is
+rewritten too. Restoring only pulses the addresses which differ from the snapshot, and only
+with the phases needed to get from the recorded value to the snapshot: a single clear pulse to
+remove bits, a single set pulse to add them.
+
+Cores disturbed by half currents are not seen until they are read, so read them before restoring
+when that matters. Only one snapshot can be tracked at a time.*/
+
+struct PlaneSnapshot {
+    uint8_t image[64];   // contents when the snapshot was taken
+    uint8_t current[64]; // what the pulses since then have left in the cores
+    uint8_t dirty[32];   // 1 bit per address, set where current differs from image
+};
+
+extern PlaneSnapshot *tracked_snapshot;
+
+// Read the whole plane into the snapshot and start tracking against it
+void snapshot_capture(PlaneSnapshot *snapshot);
+
+// Start tracking against a plane known to hold value in every address, such as after write_all,
+// without reading it
+void snapshot_assume(PlaneSnapshot *snapshot, uint8_t value);
+
+// Put the tracked snapshot back into the plane, returns the number of pulses used
+int snapshot_restore();
+
+// Stop tracking
+void snapshot_release();
+
+// Number of addresses which differ from the tracked snapshot
+int snapshot_dirty_count();
+
+// Called by write_memory_waveform
+void snapshot_track(uint8_t address, bool dir, uint8_t enable_mask);
+
+static inline uint8_t snapshot_get(const uint8_t image[64], uint8_t address) {
+    return (image[address >> 2] >> ((address & 3) * 2)) & 0b11;
+}
+
+static inline void snapshot_put(uint8_t image[64], uint8_t address, uint8_t value) {
+    int shift = (address & 3) * 2;
+    image[address >> 2] = (image[address >> 2] & ~(0b11 << shift)) | ((value & 0b11) << shift);
+}
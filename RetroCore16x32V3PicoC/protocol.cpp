@@ -0,0 +1,90 @@
+#include "protocol.h"
+
+enum ParserState : uint8_t {
+    PARSE_SYNC,
+    PARSE_LENGTH_LO,
+    PARSE_LENGTH_HI,
+    PARSE_PAYLOAD,
+    PARSE_CRC_LO,
+    PARSE_CRC_HI,
+};
+
+uint16_t protocol_crc16(uint16_t crc, const uint8_t *data, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= data[i] << 8;
+        for (int j = 0; j < 8; j++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+void protocol_parser_reset(FrameParser *parser) {
+    parser->state = PARSE_SYNC;
+    parser->length = 0;
+    parser->received = 0;
+    parser->crc = 0;
+}
+
+bool protocol_parse(FrameParser *parser, uint8_t byte) {
+    switch (parser->state) {
+    case PARSE_SYNC:
+        if (byte == PROTOCOL_SYNC) {
+            parser->state = PARSE_LENGTH_LO;
+        }
+        return false;
+
+    case PARSE_LENGTH_LO:
+        parser->length = byte;
+        parser->state = PARSE_LENGTH_HI;
+        return false;
+
+    case PARSE_LENGTH_HI:
+        parser->length |= byte << 8;
+        parser->received = 0;
+        if (parser->length > PROTOCOL_MAX_PAYLOAD) {
+            protocol_parser_reset(parser);
+        } else {
+            parser->state = parser->length ? PARSE_PAYLOAD : PARSE_CRC_LO;
+        }
+        return false;
+
+    case PARSE_PAYLOAD:
+        parser->payload[parser->received++] = byte;
+        if (parser->received == parser->length) {
+            parser->state = PARSE_CRC_LO;
+        }
+        return false;
+
+    case PARSE_CRC_LO:
+        parser->crc = byte;
+        parser->state = PARSE_CRC_HI;
+        return false;
+
+    default: {
+        parser->crc |= byte << 8;
+
+        uint8_t length[2];
+        protocol_put_u16(length, parser->length);
+        uint16_t crc = protocol_crc16(0xFFFF, length, 2);
+        crc = protocol_crc16(crc, parser->payload, parser->length);
+
+        bool valid = crc == parser->crc;
+        parser->state = PARSE_SYNC;
+        return valid;
+    }
+    }
+}
+
+uint32_t protocol_frame(const uint8_t *payload, uint16_t length, uint8_t *out) {
+    out[0] = PROTOCOL_SYNC;
+    protocol_put_u16(out + 1, length);
+    for (uint16_t i = 0; i < length; i++) {
+        out[3 + i] = payload[i];
+    }
+
+    uint16_t crc = protocol_crc16(0xFFFF, out + 1, 2 + length);
+    protocol_put_u16(out + 3 + length, crc);
+
+    return length + PROTOCOL_FRAME_OVERHEAD;
+}
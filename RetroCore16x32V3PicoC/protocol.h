@@ -0,0 +1,106 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Binary command protocol between a host and the controller, over the USB serial port.
+
+Frame:    SYNC, payload length (u16), payload, CRC-16/CCITT of the length and the payload (u16)
+Request:  sequence number (u16), opcode (u8), data length (u16), data
+Response: sequence number (u16), opcode (u8), status (u8), data length (u16), data
+
+All values are little endian. A frame may hold any number of requests (or responses), so small
+operations can share a single USB packet. Responses carry the sequence number of their request
+and may arrive in any order. Bytes outside of a valid frame (such as text printed by the test loop)
+are skipped by the parsers.*/
+
+#define PROTOCOL_SYNC 0xA5
+#define PROTOCOL_MAX_PAYLOAD 1536
+#define PROTOCOL_FRAME_OVERHEAD 5
+#define PROTOCOL_MAX_FRAME (PROTOCOL_MAX_PAYLOAD + PROTOCOL_FRAME_OVERHEAD)
+
+#define PROTOCOL_REQUEST_HEADER 5
+#define PROTOCOL_RESPONSE_HEADER 6
+
+enum CommandOpcode : uint8_t {
+    CMD_PING = 0,         // data is echoed back
+    CMD_READ = 1,         // address -> value
+    CMD_WRITE = 2,        // address, value
+    CMD_READ_BLOCK = 3,   // start address, count (u16) -> values
+    CMD_WRITE_BLOCK = 4,  // start address, values
+    CMD_WRITE_ALL = 5,    // value (0 or 1)
+    CMD_RUN_WAVEFORM = 6, // max samples (u16), encoded waveform program -> sense samples, at most max samples
+    CMD_RUN_TEST = 7,     // test id, parameters -> failures (u32)
+
+    // Test campaign, see campaign.h
+    CMD_CAMPAIGN_ADD = 8,    // test id, priority, default pattern, bit pattern, first address, last address, passes (u16) -> job index
+    CMD_CAMPAIGN_CLEAR = 9,
+    CMD_CAMPAIGN_START = 10, // time budget in us (u64, 0 for none), CampaignFlags
+    CMD_CAMPAIGN_ABORT = 11,
+    CMD_CAMPAIGN_RESUME = 12, // time budget in us (u64, 0 for none)
+    CMD_CAMPAIGN_STATUS = 13, // -> CampaignState, flags, job count, run time in us (u64),
+                              //    then per job: steps done (u32), steps in total (u32), failures (u32)
+
+    // Never a request, responses with this opcode and sequence number 0xFFFF carry telemetry events
+    CMD_TELEMETRY = 0x80,
+};
+
+enum CommandStatus : uint8_t {
+    STATUS_OK = 0,
+    STATUS_BAD_REQUEST = 1,
+    STATUS_UNKNOWN_OPCODE = 2,
+    STATUS_NO_SPACE = 3,  // the response did not fit in the response frame
+};
+
+enum CommandTest : uint8_t {
+    TEST_GALLOP = 0,       // default pattern, bit pattern
+    TEST_HALF_CURRENT = 1,
+    TEST_IMAGE = 2,
+    TEST_HALF_CURRENT_ADAPTIVE = 3,
+};
+
+struct FrameParser {
+    uint8_t state;
+    uint16_t length;
+    uint16_t received;
+    uint16_t crc;
+    uint8_t payload[PROTOCOL_MAX_PAYLOAD];
+};
+
+void protocol_parser_reset(FrameParser *parser);
+
+// Feed one received byte, returns true when parser->payload holds a complete frame of parser->length bytes
+bool protocol_parse(FrameParser *parser, uint8_t byte);
+
+// Wrap a payload in a frame, out must hold length + PROTOCOL_FRAME_OVERHEAD bytes. Returns the frame size.
+uint32_t protocol_frame(const uint8_t *payload, uint16_t length, uint8_t *out);
+
+uint16_t protocol_crc16(uint16_t crc, const uint8_t *data, uint32_t length);
+
+inline uint16_t protocol_get_u16(const uint8_t *data) {
+    return data[0] | (data[1] << 8);
+}
+
+inline void protocol_put_u16(uint8_t *data, uint16_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+}
+
+inline uint32_t protocol_get_u32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+inline void protocol_put_u32(uint8_t *data, uint32_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+inline uint64_t protocol_get_u64(const uint8_t *data) {
+    return protocol_get_u32(data) | ((uint64_t)protocol_get_u32(data + 4) << 32);
+}
+
+inline void protocol_put_u64(uint8_t *data, uint64_t value) {
+    protocol_put_u32(data, value);
+    protocol_put_u32(data + 4, value >> 32);
+}
@@ -0,0 +1,85 @@
+#include "pico/stdlib.h"
+#include "hardware/pio.h"
+#include "hardware/dma.h"
+#include "coremem.h"
+#include "sense_capture.h"
+#include "sense_capture.pio.h"
+
+// The program can not include coremem.h, keep its copy of the pin map in step
+static_assert(sense_capture_Y_EN_PIN == Y_EN_PIN, "sense_capture.pio waits on the wrong pin");
+
+// Give up on a capture when the Y drive never turned on
+#define SENSE_CAPTURE_TIMEOUT_US 100
+
+static PIO capture_pio = pio0;
+static uint capture_sm;
+static uint capture_offset;
+static int capture_dma = -1;
+static uint32_t capture_buffer[SENSE_CAPTURE_WORDS];
+
+void sense_capture_init() {
+    if (capture_dma >= 0) {
+        return;
+    }
+
+    capture_offset = pio_add_program(capture_pio, &sense_capture_program);
+    capture_sm = pio_claim_unused_sm(capture_pio, true);
+
+    // The sense pins stay normal GPIO inputs for read_memory, the PIO can read them anyway
+    pio_sm_config config = sense_capture_program_get_default_config(capture_offset);
+    sm_config_set_in_pins(&config, SENSE0_DATA_PIN);
+    sm_config_set_in_shift(&config, true, true, 32);
+    sm_config_set_fifo_join(&config, PIO_FIFO_JOIN_RX);
+    sm_config_set_clkdiv(&config, 1.0f);
+    pio_sm_init(capture_pio, capture_sm, capture_offset, &config);
+
+    capture_dma = dma_claim_unused_channel(true);
+    dma_channel_config dma_config = dma_channel_get_default_config(capture_dma);
+    channel_config_set_transfer_data_size(&dma_config, DMA_SIZE_32);
+    channel_config_set_read_increment(&dma_config, false);
+    channel_config_set_write_increment(&dma_config, true);
+    channel_config_set_dreq(&dma_config, pio_get_dreq(capture_pio, capture_sm, false));
+    dma_channel_configure(capture_dma, &dma_config, capture_buffer, &capture_pio->rxf[capture_sm], SENSE_CAPTURE_WORDS, false);
+}
+
+void sense_capture_arm() {
+    pio_sm_set_enabled(capture_pio, capture_sm, false);
+    pio_sm_clear_fifos(capture_pio, capture_sm);
+    pio_sm_restart(capture_pio, capture_sm);
+    pio_sm_exec(capture_pio, capture_sm, pio_encode_jmp(capture_offset));
+
+    dma_channel_set_write_addr(capture_dma, capture_buffer, false);
+    dma_channel_set_trans_count(capture_dma, SENSE_CAPTURE_WORDS, true);
+
+    pio_sm_set_enabled(capture_pio, capture_sm, true);
+}
+
+void sense_capture_finish(int32_t edge_cycles[2]) {
+    edge_cycles[0] = -1;
+    edge_cycles[1] = -1;
+
+    uint64_t start = time_us_64();
+    while (dma_channel_is_busy(capture_dma)) {
+        if (time_us_64() - start > SENSE_CAPTURE_TIMEOUT_US) {
+            dma_channel_abort(capture_dma);
+            pio_sm_set_enabled(capture_pio, capture_sm, false);
+            return;
+        }
+    }
+    pio_sm_set_enabled(capture_pio, capture_sm, false);
+
+    for (int word = 0; word < SENSE_CAPTURE_WORDS; word++) {
+        uint32_t samples = capture_buffer[word];
+        for (int sample = 0; sample < 16 && samples; sample++, samples >>= 2) {
+            for (int bit = 0; bit < 2; bit++) {
+                if ((samples & (1 << bit)) && edge_cycles[bit] < 0) {
+                    edge_cycles[bit] = word * 16 + sample;
+                }
+            }
+        }
+
+        if (edge_cycles[0] >= 0 && edge_cycles[1] >= 0) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Timestamps of the sense latch edges during a drive waveform.
+
+A PIO state machine waits for the Y drive to turn on and then samples SENSE0 and SENSE1 on every
+system clock cycle, DMA collects the samples. The first sample in which a latch is set tells when
+the first core of that bit switched, counted in cycles from the Y drive turning on.
+
+Usage: sense_capture_arm, run a waveform with the latch reset, sense_capture_finish.*/
+
+#define SENSE_CAPTURE_WORDS 64 // 16 samples a word, 1024 cycles of Y drive
+
+// Claims a PIO state machine and a DMA channel, called by coremem_init
+void sense_capture_init();
+
+// Start waiting for the next Y pulse
+void sense_capture_arm();
+
+// Wait for the capture to complete. edge_cycles receives the first sample in which each latch
+// was set, or -1 if it stayed clear for the whole capture.
+void sense_capture_finish(int32_t edge_cycles[2]);
@@ -0,0 +1,75 @@
+#include <math.h>
+#include "pico/stdlib.h"
+#include "coremem.h"
+#include "sense_capture.h"
+#include "switching_stats.h"
+#include "telemetry.h"
+
+void switching_stats_clear(SwitchingStats &stats) {
+    stats = {0, UINT16_MAX, 0, 0, 0, 0};
+}
+
+void switching_stats_add(SwitchingStats &stats, int32_t edge_ns) {
+    if (edge_ns < 0) {
+        stats.missed++;
+        return;
+    }
+
+    stats.samples++;
+    stats.sum_ns += edge_ns;
+    stats.sum_sq_ns += (uint64_t)edge_ns * edge_ns;
+    if (edge_ns < stats.min_ns) stats.min_ns = edge_ns;
+    if (edge_ns > stats.max_ns) stats.max_ns = edge_ns;
+}
+
+uint32_t switching_mean_ns(const SwitchingStats &stats) {
+    return stats.samples ? stats.sum_ns / stats.samples : 0;
+}
+
+uint32_t switching_stddev_ns(const SwitchingStats &stats) {
+    if (stats.samples < 2) {
+        return 0;
+    }
+
+    double mean = (double)stats.sum_ns / stats.samples;
+    double variance = (double)stats.sum_sq_ns / stats.samples - mean * mean;
+    return variance > 0 ? (uint32_t)sqrt(variance) : 0;
+}
+
+bool characterise_switching_address(uint8_t address, int rounds, SwitchingStats stats[2]) {
+    switching_stats_clear(stats[0]);
+    switching_stats_clear(stats[1]);
+
+    for (int round = 0; round < rounds; round++) {
+        write_memory(address, 0b11);
+
+        // The clearing pulse of a read, both cores switch and set their latch
+        int32_t edge_cycles[2];
+        sense_capture_arm();
+        write_memory_waveform(address, false, 0b11, true);
+        sense_capture_finish(edge_cycles);
+
+        for (int bit = 0; bit < 2; bit++) {
+            switching_stats_add(stats[bit], edge_cycles[bit] < 0 ? -1 : (int32_t)cycles_to_ns(edge_cycles[bit]));
+        }
+    }
+
+    return stats[0].missed || stats[1].missed;
+}
+
+int characterise_switching(int rounds) {
+    int missed = 0;
+
+    for (int address = 0; address < 256; address++) {
+        SwitchingStats stats[2];
+        missed += characterise_switching_address(address, rounds, stats);
+
+        for (int bit = 0; bit < 2; bit++) {
+            uint16_t min_ns = stats[bit].samples ? stats[bit].min_ns : 0;
+            telemetry_emit(EVENT_TIMING, TIMING_SWITCHING0 + bit, address, switching_mean_ns(stats[bit]), stats[bit].max_ns);
+            telemetry_emit(EVENT_TIMING, TIMING_SPREAD0 + bit, address, min_ns, switching_stddev_ns(stats[bit]));
+        }
+    }
+
+    return missed;
+}
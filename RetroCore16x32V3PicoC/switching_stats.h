@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Switching time of the cores, measured with the sense capture (see sense_capture.h).
+
+The switching time is the time from the Y drive turning on to the sense latch being set,
+which is how much of the saturation time a core actually needs.*/
+
+struct SwitchingStats {
+    uint16_t samples;
+    uint16_t min_ns;
+    uint16_t max_ns;
+    uint32_t sum_ns;
+    uint64_t sum_sq_ns;
+    uint16_t missed; // pulses in which the core did not switch within the capture
+};
+
+void switching_stats_clear(SwitchingStats &stats);
+
+// Add a captured edge, a negative edge_ns counts as missed
+void switching_stats_add(SwitchingStats &stats, int32_t edge_ns);
+
+uint32_t switching_mean_ns(const SwitchingStats &stats);
+uint32_t switching_stddev_ns(const SwitchingStats &stats);
+
+// Write 0b11 to an address and capture the pulse which clears it again, rounds times.
+// stats receives the statistics of both bits. Returns true if a bit did not switch within the
+// capture at least once.
+bool characterise_switching_address(uint8_t address, int rounds, SwitchingStats stats[2]);
+
+// Characterise every address, the statistics of each are logged as telemetry as soon as it is
+// done (TIMING_SWITCHING0/1 and TIMING_SPREAD0/1). Returns the number of addresses where a bit
+// did not switch within the capture at least once. This overwrites the whole memory.
+int characterise_switching(int rounds);
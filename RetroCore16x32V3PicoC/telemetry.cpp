@@ -0,0 +1,86 @@
+#include <atomic>
+#include "pico/stdlib.h"
+#include "telemetry.h"
+#include "command.h"
+
+static TelemetryEvent ring[TELEMETRY_CAPACITY];
+
+// Free running counters, head only written by the producer, tail only by the consumer
+static std::atomic<uint32_t> head;
+static std::atomic<uint32_t> tail;
+static std::atomic<uint32_t> dropped;
+
+static uint32_t reported_dropped;
+
+bool telemetry_emit(uint8_t type, uint8_t id, uint16_t address, uint32_t value, uint32_t extra) {
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) >= TELEMETRY_CAPACITY) {
+        dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return false;
+    }
+
+    TelemetryEvent &event = ring[h % TELEMETRY_CAPACITY];
+    event.time_us = time_us_32();
+    event.type = type;
+    event.id = id;
+    event.address = address;
+    event.value = value;
+    event.extra = extra;
+
+    // Publish the event only once it is complete
+    head.store(h + 1, std::memory_order_release);
+    return true;
+}
+
+uint32_t telemetry_fill(uint8_t *payload, uint32_t max) {
+    if (max < PROTOCOL_RESPONSE_HEADER + TELEMETRY_EVENT_SIZE) {
+        return 0;
+    }
+
+    uint32_t length = PROTOCOL_RESPONSE_HEADER;
+
+    uint32_t lost = dropped.load(std::memory_order_relaxed);
+    if (lost != reported_dropped) {
+        TelemetryEvent event = {time_us_32(), EVENT_DROPPED, 0, 0, lost, 0};
+        telemetry_encode(event, payload + length);
+        length += TELEMETRY_EVENT_SIZE;
+        reported_dropped = lost;
+    }
+
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    while (t != h && length + TELEMETRY_EVENT_SIZE <= max) {
+        telemetry_encode(ring[t % TELEMETRY_CAPACITY], payload + length);
+        length += TELEMETRY_EVENT_SIZE;
+        t++;
+    }
+    // Hand the slots back to the producer
+    tail.store(t, std::memory_order_release);
+
+    if (length == PROTOCOL_RESPONSE_HEADER) {
+        return 0;
+    }
+
+    protocol_put_u16(payload, 0xFFFF);
+    payload[2] = CMD_TELEMETRY;
+    payload[3] = STATUS_OK;
+    protocol_put_u16(payload + 4, length - PROTOCOL_RESPONSE_HEADER);
+    return length;
+}
+
+bool telemetry_drain() {
+    // Up to 16 events in a frame
+    static uint8_t payload[PROTOCOL_RESPONSE_HEADER + 16 * TELEMETRY_EVENT_SIZE];
+
+    uint32_t length = telemetry_fill(payload, sizeof(payload));
+    if (!length) {
+        return false;
+    }
+
+    command_send(payload, length);
+    return true;
+}
+
+uint32_t telemetry_dropped() {
+    return dropped.load(std::memory_order_relaxed);
+}
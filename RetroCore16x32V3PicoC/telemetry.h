@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include "protocol.h"
+
+/* Binary event log, so the memory operations never wait on USB.
+
+Events go into a lock-free ring with a single producer (core 0, the memory operations) and a
+single consumer, which sends them to the host as CMD_TELEMETRY responses (see protocol.h).
+Emitting an event is a handful of stores; when the ring is full the event is dropped and
+counted, the consumer reports the count with an EVENT_DROPPED event.
+
+Event, 16 bytes little endian: time (us, u32), type (u8), id (u8), address (u16), value (u32), extra (u32)*/
+
+#define TELEMETRY_CAPACITY 256 // events, a power of 2
+#define TELEMETRY_EVENT_SIZE 16
+
+enum TelemetryEventType : uint8_t {
+    EVENT_TEST_RESULT = 1, // id: test (CommandTest), address: variant, value: failures, extra: duration in us
+    EVENT_READ_ERROR = 2,  // id: wrong bits, address, value: expected, extra: read back
+    EVENT_TIMING = 3,      // id: TelemetryTiming, address, value: duration in ns
+    EVENT_CALIBRATION = 4, // id: TelemetryCalibration, value: bad addresses
+    EVENT_DROPPED = 5,     // value: events dropped since boot
+    EVENT_DISTURB = 6,     // address: failing addresses, value: pulses, extra: failure rate bound (float)
+    EVENT_JITTER = 7,      // id: WaveformPhase, address: histogram bin, value: count, extra: largest excess in cycles
+    EVENT_WEAK_READ = 8,   // id: samples reading 1 (bit 0 in the low nibble), address, value: samples, extra: voted value
+    EVENT_CAMPAIGN = 9,    // id: CampaignState it ended in, address: jobs done, value: failures, extra: run time in ms
+    EVENT_CAMPAIGN_PROGRESS = 10, // id: job, address: passes done, value: steps done, extra: failures so far
+    EVENT_BAD_CORES = 11,  // id: job, address: test address, value: cores newly found bad, extra: failed cores already known bad
+};
+
+enum TelemetryTiming : uint8_t {
+    TIMING_SATURATION = 0, // characterised saturation time of an address
+    TIMING_SWITCHING0 = 1, // mean switching time of an address, extra: the longest
+    TIMING_SWITCHING1 = 2,
+    TIMING_SETTLE = 3,     // characterised recovery time of an address
+    TIMING_SPREAD0 = 4,    // shortest switching time of an address, extra: the standard deviation
+    TIMING_SPREAD1 = 5,
+};
+
+enum TelemetryCalibration : uint8_t {
+    CALIBRATION_LOADED = 0,
+    CALIBRATION_CHARACTERISED = 1,
+    CALIBRATION_SAVE_FAILED = 2,
+};
+
+struct TelemetryEvent {
+    uint32_t time_us;
+    uint8_t type;
+    uint8_t id;
+    uint16_t address;
+    uint32_t value;
+    uint32_t extra;
+};
+
+// Returns false if the ring was full and the event was dropped
+bool telemetry_emit(uint8_t type, uint8_t id, uint16_t address, uint32_t value, uint32_t extra);
+
+static inline void telemetry_read_error(uint8_t address, uint8_t expected, uint8_t actual) {
+    telemetry_emit(EVENT_READ_ERROR, expected ^ actual, address, expected, actual);
+}
+
+static inline uint32_t float_bits(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+// Consumer side: move the pending events into a CMD_TELEMETRY response payload of at most max bytes.
+// Returns its size, 0 if there was nothing to send.
+uint32_t telemetry_fill(uint8_t *payload, uint32_t max);
+
+// Consumer side: send the pending events over stdio, returns false if there were none
+bool telemetry_drain();
+
+uint32_t telemetry_dropped();
+
+static inline void telemetry_encode(const TelemetryEvent &event, uint8_t *data) {
+    protocol_put_u32(data, event.time_us);
+    data[4] = event.type;
+    data[5] = event.id;
+    protocol_put_u16(data + 6, event.address);
+    protocol_put_u32(data + 8, event.value);
+    protocol_put_u32(data + 12, event.extra);
+}
+
+static inline void telemetry_decode(const uint8_t *data, TelemetryEvent *event) {
+    event->time_us = protocol_get_u32(data);
+    event->type = data[4];
+    event->id = data[5];
+    event->address = protocol_get_u16(data + 6);
+    event->value = protocol_get_u32(data + 8);
+    event->extra = protocol_get_u32(data + 12);
+}
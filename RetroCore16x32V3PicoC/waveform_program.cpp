@@ -0,0 +1,247 @@
+#include "pico/stdlib.h"
+#include "waveform_program.h"
+
+// Pins a program is allowed to drive, everything up to the debug pin, but never the sense inputs
+#define WAVE_OUTPUT_PINS ((1u << (DEBUG_EVENT_PIN + 1)) - 1)
+
+// Longest single step
+#define WAVE_MAX_STEP_NS 10000000
+
+// Pins which turn on a drive current, a bridge conducts while its enable pin is high
+#define WAVE_DRIVE_PINS ((1u << IHB0_EN_PIN) | (1u << IHB1_EN_PIN) | (1u << X_EN_PIN) | (1u << Y_EN_PIN))
+
+// Longest time the drives may stay on without a break, well above the saturation time plus
+// the setup and settle phases of a waveform
+#define WAVE_MAX_DRIVE_NS 5000
+
+// Time all drives have to be off before they are turned on again, so the current limiting
+// resistors do not overheat (the cooldown of write_memory_waveform)
+#define WAVE_MIN_COOLDOWN_NS 500
+
+// Longest run time of a whole program, with every loop iteration and at least
+// WAVE_STEP_OVERHEAD_NS per executed step, so an uploaded program can not hang the controller
+#define WAVE_MAX_RUN_NS 100000000
+#define WAVE_STEP_OVERHEAD_NS 50
+
+static WaveformProgram scratch_program;
+
+// Add the run time of a step executed iterations times, returns false once over the limit
+static bool add_run_time(uint64_t *run_ns, uint32_t duration, uint64_t iterations) {
+    uint64_t cost = duration > WAVE_STEP_OVERHEAD_NS ? duration : WAVE_STEP_OVERHEAD_NS;
+    if (iterations > WAVE_MAX_RUN_NS / cost) {
+        return false;
+    }
+    *run_ns += cost * iterations;
+    return *run_ns <= WAVE_MAX_RUN_NS;
+}
+
+bool waveform_load(WaveformProgram *program, const WaveformStep *steps, int count) {
+    int depth = 0;
+
+    // The drives are off when a program starts. A loop has to start and end with them off, so
+    // the drive state of every step is known without running the program.
+    uint32_t drive = 0;
+    bool was_driving;
+    uint32_t on_ns = 0;
+    uint32_t off_ns = WAVE_MIN_COOLDOWN_NS;
+    bool loop_drives[WAVEFORM_MAX_LOOP_DEPTH];
+    uint64_t iterations[WAVEFORM_MAX_LOOP_DEPTH + 1] = {1};
+    uint64_t run_ns = 0;
+
+    for (int i = 0; i < count; i++) {
+        if (i >= WAVEFORM_MAX_STEPS) {
+            return false;
+        }
+
+        WaveformStep step = steps[i];
+        switch (step.op) {
+        case WAVE_STEP:
+            if ((step.mask & ~WAVE_OUTPUT_PINS) || step.duration > WAVE_MAX_STEP_NS) {
+                return false;
+            }
+
+            was_driving = drive != 0;
+            drive = (drive & ~step.mask) | (step.value & step.mask & WAVE_DRIVE_PINS);
+            if (drive) {
+                if (!was_driving && off_ns < WAVE_MIN_COOLDOWN_NS) {
+                    return false;
+                }
+                on_ns += step.duration;
+                off_ns = 0;
+                if (on_ns > WAVE_MAX_DRIVE_NS) {
+                    return false;
+                }
+                if (depth > 0) {
+                    loop_drives[depth - 1] = true;
+                }
+            } else {
+                on_ns = 0;
+                off_ns += step.duration;
+            }
+
+            if (!add_run_time(&run_ns, step.duration, iterations[depth])) {
+                return false;
+            }
+            step.duration = ns_to_cycles(step.duration);
+            break;
+
+        case WAVE_LOOP:
+            if (step.count == 0 || depth == WAVEFORM_MAX_LOOP_DEPTH || drive) {
+                return false;
+            }
+            loop_drives[depth] = false;
+            iterations[depth + 1] = iterations[depth] * step.count;
+            depth++;
+            if (!add_run_time(&run_ns, 0, iterations[depth - 1])) {
+                return false;
+            }
+            break;
+
+        case WAVE_END_LOOP:
+            if (depth == 0 || drive) {
+                return false;
+            }
+            // The next iteration turns the drives on again after the end of this one
+            if (loop_drives[depth - 1] && off_ns < WAVE_MIN_COOLDOWN_NS) {
+                return false;
+            }
+            if (!add_run_time(&run_ns, 0, iterations[depth])) {
+                return false;
+            }
+            depth--;
+            if (depth > 0 && loop_drives[depth]) {
+                loop_drives[depth - 1] = true;
+            }
+            break;
+
+        case WAVE_END:
+            if (depth != 0) {
+                return false;
+            }
+            program->steps[i] = step;
+            program->length = i + 1;
+            return true;
+
+        default:
+            return false;
+        }
+
+        program->steps[i] = step;
+    }
+
+    // No END
+    return false;
+}
+
+static uint32_t get_u32(const uint8_t *data) {
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+static void put_u32(uint8_t *data, uint32_t value) {
+    data[0] = value;
+    data[1] = value >> 8;
+    data[2] = value >> 16;
+    data[3] = value >> 24;
+}
+
+bool waveform_decode(WaveformProgram *program, const uint8_t *data, uint32_t size) {
+    if (size % WAVEFORM_STEP_SIZE != 0 || size / WAVEFORM_STEP_SIZE > WAVEFORM_MAX_STEPS) {
+        return false;
+    }
+
+    int count = size / WAVEFORM_STEP_SIZE;
+    for (int i = 0; i < count; i++) {
+        const uint8_t *encoded = data + i * WAVEFORM_STEP_SIZE;
+        WaveformStep &step = scratch_program.steps[i];
+        step.op = encoded[0];
+        step.flags = encoded[1];
+        step.count = encoded[2] | (encoded[3] << 8);
+        step.mask = get_u32(encoded + 4);
+        step.value = get_u32(encoded + 8);
+        step.duration = get_u32(encoded + 12);
+    }
+
+    return waveform_load(program, scratch_program.steps, count);
+}
+
+uint32_t waveform_encode(const WaveformStep *steps, int count, uint8_t *data, uint32_t size) {
+    uint32_t length = 0;
+
+    for (int i = 0; i < count && length + WAVEFORM_STEP_SIZE <= size; i++) {
+        uint8_t *encoded = data + length;
+        encoded[0] = steps[i].op;
+        encoded[1] = steps[i].flags;
+        encoded[2] = steps[i].count;
+        encoded[3] = steps[i].count >> 8;
+        put_u32(encoded + 4, steps[i].mask);
+        put_u32(encoded + 8, steps[i].value);
+        put_u32(encoded + 12, steps[i].duration);
+        length += WAVEFORM_STEP_SIZE;
+    }
+
+    return length;
+}
+
+uint32_t waveform_run(const WaveformProgram *program, uint8_t *samples, uint32_t max_samples) {
+    uint16_t loop_start[WAVEFORM_MAX_LOOP_DEPTH];
+    uint16_t loop_remaining[WAVEFORM_MAX_LOOP_DEPTH];
+    int depth = 0;
+
+    uint32_t sampled = 0;
+    uint16_t pc = 0;
+
+    while (true) {
+        const WaveformStep &step = program->steps[pc];
+
+        switch (step.op) {
+        case WAVE_STEP:
+            gpio_put_masked(step.mask, step.value);
+            busy_wait_at_least_cycles(step.duration);
+
+            if (step.flags & WAVE_FLAG_SAMPLE) {
+                if (sampled < max_samples) {
+                    samples[sampled] = (gpio_get_all() >> SENSE0_DATA_PIN) & 0b11;
+                }
+                sampled++;
+            }
+            pc++;
+            break;
+
+        case WAVE_LOOP:
+            loop_start[depth] = pc + 1;
+            loop_remaining[depth] = step.count;
+            depth++;
+            pc++;
+            break;
+
+        case WAVE_END_LOOP:
+            if (--loop_remaining[depth - 1] > 0) {
+                pc = loop_start[depth - 1];
+            } else {
+                depth--;
+                pc++;
+            }
+            break;
+
+        default:
+            // Never leave any current flowing
+            set_y_drv(MosfetBridgeState::NONE_CONDUCT);
+            set_ihb0(MosfetBridgeState::NONE_CONDUCT);
+            set_ihb1(MosfetBridgeState::NONE_CONDUCT);
+            set_x_drv(MosfetBridgeState::NONE_CONDUCT);
+
+            // The next waveform may turn the drives on straight away
+            busy_wait_at_least_cycles(ns_to_cycles(WAVE_MIN_COOLDOWN_NS));
+            return sampled;
+        }
+    }
+}
+
+bool waveform_execute(const WaveformStep *steps, int count) {
+    if (!waveform_load(&scratch_program, steps, count)) {
+        return false;
+    }
+
+    waveform_run(&scratch_program, nullptr, 0);
+    return true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+#include "coremem.h"
+
+/* A small bytecode for diagnostic pulse programs.
+
+A program is a list of steps. A step drives a set of pins, waits for its duration and optionally
+samples the sense latches afterwards. Steps can be repeated with LOOP / END_LOOP, and a program
+always finishes with END. The drives are always turned off when a program finishes, so a
+program can not leave current flowing through the resistors.
+
+Programs are checked when they are loaded, as they may come from the host: the drives may only
+stay on for a few microseconds at a time, have to be off for the cooldown of the driver before
+they are turned on again, and must be off where a loop starts and ends. The whole program,
+with every loop iteration, has to finish within 100ms.
+
+The durations are given in nanoseconds and converted to cycles once when the program is loaded,
+so the interpreter only has to write the pins and busy wait.*/
+
+#define WAVEFORM_MAX_STEPS 64
+#define WAVEFORM_MAX_LOOP_DEPTH 4
+
+// Size of a step when encoded for upload
+#define WAVEFORM_STEP_SIZE 16
+
+enum WaveformOp : uint8_t {
+    WAVE_END = 0,
+    WAVE_STEP = 1,
+    WAVE_LOOP = 2,
+    WAVE_END_LOOP = 3,
+};
+
+#define WAVE_FLAG_SAMPLE 0x01
+
+struct WaveformStep {
+    uint8_t op;
+    uint8_t flags;
+    uint16_t count;     // iterations of a LOOP
+    uint32_t mask;      // pins driven by a STEP
+    uint32_t value;
+    uint32_t duration;  // nanoseconds, cycles once loaded
+};
+
+struct WaveformProgram {
+    WaveformStep steps[WAVEFORM_MAX_STEPS];
+    uint16_t length;
+};
+
+struct WavePins {
+    uint32_t mask;
+    uint32_t value;
+};
+
+constexpr WavePins operator|(WavePins a, WavePins b) {
+    return {a.mask | b.mask, (a.value & ~b.mask) | b.value};
+}
+
+constexpr WavePins wave_x_drv(MosfetBridgeState state) {
+    return {(1u << X_DIR_PIN) | (1u << X_EN_PIN), (uint32_t)state << X_EN_PIN};
+}
+
+constexpr WavePins wave_y_drv(MosfetBridgeState state) {
+    return {(1u << Y_DIR_PIN) | (1u << Y_EN_PIN), (uint32_t)state << Y_EN_PIN};
+}
+
+constexpr WavePins wave_ihb0(MosfetBridgeState state) {
+    return {(1u << IHB0_DIR_PIN) | (1u << IHB0_EN_PIN), (uint32_t)state << IHB0_EN_PIN};
+}
+
+constexpr WavePins wave_ihb1(MosfetBridgeState state) {
+    return {(1u << IHB1_DIR_PIN) | (1u << IHB1_EN_PIN), (uint32_t)state << IHB1_EN_PIN};
+}
+
+constexpr WavePins wave_address(uint8_t address) {
+    return {0xFFu << ADDR_X0_PIN, (uint32_t)address << ADDR_X0_PIN};
+}
+
+constexpr WavePins wave_reset_latch(bool state) {
+    return {1u << SENSE_RST_PIN, (uint32_t)state << SENSE_RST_PIN};
+}
+
+constexpr WavePins wave_debug(bool state) {
+    return {1u << DEBUG_EVENT_PIN, (uint32_t)state << DEBUG_EVENT_PIN};
+}
+
+constexpr WavePins wave_none() {
+    return {0, 0};
+}
+
+constexpr WaveformStep wave_step(WavePins pins, uint32_t duration_ns, bool sample = false) {
+    return {WAVE_STEP, (uint8_t)(sample ? WAVE_FLAG_SAMPLE : 0), 0, pins.mask, pins.value, duration_ns};
+}
+
+constexpr WaveformStep wave_loop(uint16_t count) {
+    return {WAVE_LOOP, 0, count, 0, 0, 0};
+}
+
+constexpr WaveformStep wave_end_loop() {
+    return {WAVE_END_LOOP, 0, 0, 0, 0, 0};
+}
+
+constexpr WaveformStep wave_end() {
+    return {WAVE_END, 0, 0, 0, 0, 0};
+}
+
+// Validate the steps and convert the durations to cycles, returns false if the program is not valid
+bool waveform_load(WaveformProgram *program, const WaveformStep *steps, int count);
+
+// Same as waveform_load, from the encoded form of an uploaded program (little endian, WAVEFORM_STEP_SIZE bytes per step)
+bool waveform_decode(WaveformProgram *program, const uint8_t *data, uint32_t size);
+
+// Encode steps for upload, returns the number of bytes written
+uint32_t waveform_encode(const WaveformStep *steps, int count, uint8_t *data, uint32_t size);
+
+// Run a loaded program, the sense latches of every sampled step are stored in samples (bit 0 is SENSE0)
+// Returns the number of samples taken, which may be more than max_samples.
+uint32_t waveform_run(const WaveformProgram *program, uint8_t *samples, uint32_t max_samples);
+
+// Load and run a list of steps, returns false if the steps are not a valid program
+bool waveform_execute(const WaveformStep *steps, int count);
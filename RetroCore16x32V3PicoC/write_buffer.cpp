@@ -0,0 +1,58 @@
+#include "coremem.h"
+#include "write_buffer.h"
+
+static uint8_t buffer_value[256];
+static uint8_t buffer_mask[256]; // 0 if the address is not buffered
+static int pending;
+
+void buffered_write(uint8_t address, uint8_t value, uint8_t mask) {
+    mask &= 0b11;
+    if (!mask) {
+        return;
+    }
+
+    if (!buffer_mask[address]) {
+        if (pending == WRITE_BUFFER_SIZE) {
+            write_buffer_flush();
+        }
+        pending++;
+    }
+
+    buffer_value[address] = (buffer_value[address] & ~mask) | (value & mask);
+    buffer_mask[address] |= mask;
+}
+
+uint8_t buffered_read(uint8_t address) {
+    uint8_t mask = buffer_mask[address];
+    if (mask == 0b11) {
+        return buffer_value[address];
+    }
+
+    uint8_t value = read_memory(address);
+    return (value & ~mask) | (buffer_value[address] & mask);
+}
+
+void write_buffer_flush() {
+    // Gray code order, every write only changes one address line compared to the previous one
+    for (int i = 0; i < 256 && pending > 0; i++) {
+        uint8_t address = i ^ (i >> 1);
+        uint8_t mask = buffer_mask[address];
+        if (!mask) {
+            continue;
+        }
+
+        uint8_t value = buffer_value[address];
+        if (mask != 0b11) {
+            value = (read_memory(address) & ~mask) | (value & mask);
+        }
+        write_memory(address, value);
+
+        buffer_mask[address] = 0;
+        buffer_value[address] = 0;
+        pending--;
+    }
+}
+
+int write_buffer_pending() {
+    return pending;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+/* Opt-in write combining on top of write_memory.
+
+Buffered writes are collected per address: a later write to the same address replaces the bits
+it covers (last writer wins) and the bit masks are merged, so an address written many times
+costs a single write_memory when the buffer is flushed. Reads of buffered bits are served from
+the buffer, without touching the cores.
+
+The flush visits the addresses in Gray code order, so consecutive writes change only one
+address line. Bits which were never written are read back first (read-modify-write), unless a
+full mask was written to the address. The buffer is flushed by write_buffer_flush (a barrier)
+or when WRITE_BUFFER_SIZE different addresses are pending. Code which uses write_memory or
+read_memory directly must flush first.*/
+
+#define WRITE_BUFFER_SIZE 64
+
+// Write the bits of value selected by mask (bit 0 and/or bit 1) to an address
+void buffered_write(uint8_t address, uint8_t value, uint8_t mask = 0b11);
+
+uint8_t buffered_read(uint8_t address);
+
+void write_buffer_flush();
+
+// Number of addresses waiting to be written
+int write_buffer_pending();